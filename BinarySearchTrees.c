@@ -1,6 +1,13 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<limits.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#include<unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#endif
 
 /* We implement binary search trees, which are binary trees such that each node is greater than or equal to its left child and
 lesser than its right child (if they exist, of course). The biggest advantage of this data structure is that the search operation has 
@@ -349,6 +356,158 @@ void BST_print_breadth_first(BST *b){
 
 /* END OF PRINTING FUNCTIONS */
 
+/* ITERATORS */
+
+/* The iterative traversals above push a malloc'ed STA node for each visited node (and the QA queue also walks the whole queue 
+at each dequeue). Here we write iterators which do not allocate memory at all. An iterator is a structure holding the state of
+a traversal: a stack (or a queue, for the level order) stored in a vector, and a few pointers. Each call to BSTI_next returns 
+the next node of the traversal, or NULL at the end, so the traversal may be paused after any node and resumed later -- for 
+example, to consume a tree in pieces -- as long as the tree is not modified in between. 
+
+The stack of an in-order, preorder or postorder traversal holds at most one path from the root, so its size is the height of 
+the tree. The iterator has room for BSTI_INLINE_CAPACITY pointers inside itself, which is enough for any AVL and, in practice,
+for BST's built from keys in random order. For taller trees, or for the level order (whose queue holds a whole level of the 
+tree), the caller passes a vector of its own (buffer, with capacity pointers), which may be on the call stack. If the vector 
+turns out to be too small, the traversal stops: BSTI_next returns NULL and the field overflow is set to 1.
+
+We do not use Morris threading here (see BST_inorder_to_array): a paused Morris traversal leaves the tree temporarily modified. */
+
+#define BSTI_INLINE_CAPACITY 64
+
+#define BSTI_INORDER 0
+#define BSTI_REVERSE_INORDER 1
+#define BSTI_PREORDER 2
+#define BSTI_POSTORDER 3
+#define BSTI_LEVEL_ORDER 4
+#define BSTI_RANGE 5 /* in-order, restricted to the keys in [low,high); see BSTI_range_initialize */
+
+typedef struct bst_iterator{
+    int order;
+    BST **stack;     /* stack (or circular queue) of nodes */
+    int capacity, top, head;
+    int overflow;
+    BST *node, *last; /* next subtree to descend and last returned node */
+    int high;         /* end of the range, for BSTI_RANGE */
+    BST *inline_stack[BSTI_INLINE_CAPACITY];
+}BSTI; /* BSTI stands for BST Iterator */
+
+int BSTI_push(BSTI *it, BST *b){
+    if(it->top == it->capacity){
+        it->overflow = 1;
+        return 0;
+    }
+    it->stack[it->top++] = b;
+    return 1;
+}
+
+/* For the level order, stack is a circular queue: head is the position of its first node and top is its number of nodes. */
+
+int BSTI_enqueue(BSTI *it, BST *b){
+    if(it->top == it->capacity){
+        it->overflow = 1;
+        return 0;
+    }
+    it->stack[(it->head + it->top) % it->capacity] = b;
+    it->top++;
+    return 1;
+}
+
+void BSTI_initialize(BSTI *it, BST *b, int order, BST **buffer, int capacity){
+    it->order = order;
+    it->stack = buffer ? buffer : it->inline_stack;
+    it->capacity = buffer ? capacity : BSTI_INLINE_CAPACITY;
+    it->top = it->head = 0;
+    it->overflow = 0;
+    it->node = b;
+    it->last = NULL;
+    it->high = INT_MAX;
+    if(b && (order == BSTI_PREORDER || order == BSTI_LEVEL_ORDER)){
+        it->node = NULL;
+        BSTI_push(it,b);
+    }
+}
+
+/* A range iterator visits, in order, the keys in [low,high). Instead of starting at the minimum, we go down from the root 
+towards low and stack every node whose key is >= low (as we go to its left subtree). This is exactly the stack an in-order 
+traversal would have just before visiting the first key >= low, so the iteration takes O(h + k) time for k keys, where h is the
+height of the tree, instead of the O(n) time of BST_lesser_than_n or BST_valid_range. */
+
+void BSTI_range_initialize(BSTI *it, BST *b, int low, int high, BST **buffer, int capacity){
+    BSTI_initialize(it,NULL,BSTI_RANGE,buffer,capacity);
+    it->high = high;
+    while(b){
+        if(b->key >= low){
+            if(!BSTI_push(it,b)) return;
+            b = b->left;
+        }
+        else b = b->right;
+    }
+}
+
+BST *BSTI_next(BSTI *it){
+    BST *output;
+    if(it->overflow) return NULL;
+    switch(it->order){
+        case BSTI_INORDER:
+        case BSTI_RANGE:
+            while(it->node){
+                if(!BSTI_push(it,it->node)) return NULL;
+                it->node = it->node->left;
+            }
+            if(it->top == 0) return NULL;
+            output = it->stack[--it->top];
+            if(it->order == BSTI_RANGE && output->key >= it->high){
+                it->top = 0;
+                return NULL;
+            }
+            it->node = output->right;
+            return output;
+        case BSTI_REVERSE_INORDER:
+            while(it->node){
+                if(!BSTI_push(it,it->node)) return NULL;
+                it->node = it->node->right;
+            }
+            if(it->top == 0) return NULL;
+            output = it->stack[--it->top];
+            it->node = output->left;
+            return output;
+        case BSTI_PREORDER:
+            if(it->top == 0) return NULL;
+            output = it->stack[--it->top];
+            if(output->right && !BSTI_push(it,output->right)) return NULL;
+            if(output->left && !BSTI_push(it,output->left)) return NULL;
+            return output;
+        case BSTI_POSTORDER:
+            while(it->top > 0 || it->node){
+                if(it->node){
+                    if(!BSTI_push(it,it->node)) return NULL;
+                    it->node = it->node->left;
+                }
+                else{
+                    BST *peek = it->stack[it->top-1];
+                    if(peek->right && it->last != peek->right) it->node = peek->right;
+                    else{
+                        it->top--;
+                        it->last = peek;
+                        return peek;
+                    }
+                }
+            }
+            return NULL;
+        case BSTI_LEVEL_ORDER:
+            if(it->top == 0) return NULL;
+            output = it->stack[it->head];
+            it->head = (it->head + 1) % it->capacity;
+            it->top--;
+            if(output->left && !BSTI_enqueue(it,output->left)) return NULL;
+            if(output->right && !BSTI_enqueue(it,output->right)) return NULL;
+            return output;
+    }
+    return NULL;
+}
+
+/* END OF ITERATORS */
+
 
 /* THE LIBRARY */
 
@@ -357,6 +516,44 @@ int BST_number_of_nodes(BST *b){
     return 1 + BST_number_of_nodes(b->left) + BST_number_of_nodes(b->right);
 }
 
+/* The height is the number of nodes in the longest path from the root (0 for the empty tree). A recursive version would
+go as deep as the tree, which is too deep for a degenerate BST (built from sorted keys, for example), so we walk the tree 
+with a stack of (node, depth) pairs in vectors that grow when needed. Each level of the path being visited leaves at most
+one pending node (its right child) in the stack, so the vectors never get much longer than the height. */
+
+int BST_height(BST *b){
+    int capacity = 64, top = 0, height = 0;
+    BST **nodes = (BST**)malloc(capacity*sizeof(BST*));
+    int *depths = (int*)malloc(capacity*sizeof(int));
+    if(b){
+        nodes[0] = b;
+        depths[0] = 1;
+        top = 1;
+    }
+    while(top){
+        top--;
+        BST *node = nodes[top];
+        int depth = depths[top];
+        if(depth > height) height = depth;
+        if(top+2 > capacity){
+            capacity *= 2;
+            nodes = (BST**)realloc(nodes,capacity*sizeof(BST*));
+            depths = (int*)realloc(depths,capacity*sizeof(int));
+        }
+        if(node->right){
+            nodes[top] = node->right;
+            depths[top++] = depth+1;
+        }
+        if(node->left){
+            nodes[top] = node->left;
+            depths[top++] = depth+1;
+        }
+    }
+    free(nodes);
+    free(depths);
+    return height;
+}
+
 /* A node for a BST has pointers to its children, but no pointer for its parent. The function below returns 
 the parent node of a node in a BST b whose key is n. We consider the first 
 ocurrence of n in the tree (from the root, of course). */
@@ -768,43 +965,38 @@ BST *BST_valid_range(BST *b, int min, int max){
 }
 
 /* Now we write a function which finds a pair in a BST having a given sum. Of course, we may put all elements in a vector and 
-implement an O(n^2) algorithm using brute force. However, there is an O(n) solution. First, we put the keys in a sorted vector.
-Then, we start by adding the greatest and the smallest keys. 
-If this sum is greater than the desired sum, then the greatest key is replaced by its predecessor. Otherwise, if 
-this sum is smaller than the desired sum, then the smallest key is replaced by its sucessor. We do that until we reach the 
-desired sum. If the sum is not found, then the function returns NULL. To return the pair, we use a linked list of BST addresses. */
+implement an O(n^2) algorithm using brute force. However, there is an O(n) solution. We walk through the keys from both ends at 
+the same time: one in-order iterator gives the keys from the smallest, and a reverse in-order iterator gives them from the greatest. 
+If the sum of the two current keys is greater than the desired sum, then the greatest key is replaced by its predecessor (the 
+next node of the reverse iterator). Otherwise, if this sum is smaller than the desired sum, then the smallest key is replaced by
+its sucessor. We do that until we reach the desired sum or the two iterators meet at the same node. If the sum is not found, then 
+the function returns NULL. To return the pair, we use a linked list of BST addresses. 
+
+The iterators keep only the paths from the root (see the section on iterators), so we do not need a vector with all the nodes;
+each of them gets a vector with room for the longest path, that is, the height of the tree. The vectors are malloc'ed: on a
+degenerate tree the height is the number of nodes, which would not fit on the call stack. */
 
 LLA *BST_pair_having_sum(BST *b, int sum){
-    BST *iter = b;
     LLA *output = LLA_initialize();
-    STA *aux_stack = STA_initialize();
-    int n = BST_number_of_nodes(b);
-    BST *vec[n];
-    int i = 0;
-    if(n < 2) return NULL;
-    while(aux_stack || iter){
-        if(iter){
-            aux_stack = STA_push(aux_stack,iter);
-            iter = iter->left;
+    if(!b || (!b->left && !b->right)) return NULL;
+    int h = BST_height(b);
+    BST **forward_stack = (BST**)malloc(h*sizeof(BST*)), **backward_stack = (BST**)malloc(h*sizeof(BST*));
+    BSTI forward, backward;
+    BSTI_initialize(&forward,b,BSTI_INORDER,forward_stack,h);
+    BSTI_initialize(&backward,b,BSTI_REVERSE_INORDER,backward_stack,h);
+    BST *low = BSTI_next(&forward), *high = BSTI_next(&backward);
+    while(low != high){
+        if(low->key + high->key == sum){
+            output = LLA_insert_tail(output,low);
+            output = LLA_insert_tail(output,high);
+            break;
         }
-        else{
-            iter = STA_pop(&aux_stack)->bst_address;
-            vec[i++] = iter;
-            iter = iter->right;
-        }
-    }
-    i = 0; 
-    int j = n-1;
-    while(i<n && j>=0){
-        if(vec[i]->key+vec[j]->key == sum){
-            output = LLA_insert_tail(output,vec[i]);
-            output = LLA_insert_tail(output,vec[j]);
-            return output;
-        }
-        else if(vec[i]->key+vec[j]->key > sum) j--;
-        else i++;
+        else if(low->key + high->key > sum) high = BSTI_next(&backward);
+        else low = BSTI_next(&forward);
     }
-    return NULL;
+    free(forward_stack);
+    free(backward_stack);
+    return output;
 }
 
 /* We can do the same to a sum of three keys in a BST. The difference is that we keep two pointers in the head 
@@ -1010,8 +1202,2327 @@ int same_bst_from_arrays(int *vec1, int *vec2, int n){
     return 1;
 }
 
-int main(){
+/* AVL TREES */
 
-    
+/* All the functions above run in O(h) time, where h is the height of the tree. If the keys are inserted in a "random" order,
+then h is O(logn), but nothing guarantees that. If we insert the keys 1, 2, ..., n in this order, each new key becomes the right 
+child of the previous one, and the BST degenerates into a linked list with height n: every operation becomes O(n), and the recursive
+functions need n nested calls (which overflows the call stack for large n).
+
+An AVL tree (after Adelson-Velsky and Landis) is a BST which stays balanced: for any node, the heights of its left and right 
+subtrees differ by at most 1. This implies that the height of an AVL tree with n nodes is at most about 1.44*log2(n). To keep
+that property, each node stores the height of the subtree rooted at it. After an insertion or a remotion, we walk back up the 
+path to the root and, whenever a node is unbalanced (the difference of heights is 2), we fix it with one or two "rotations".
+
+A right rotation at a node y whose left child is x works as follows: x becomes the root of the subtree, y becomes the right 
+child of x and the old right subtree of x becomes the left subtree of y. The in-order sequence of keys does not change, so
+the result is still a BST. A left rotation is symmetric.
+
+            y                 x
+           / \               / \
+          x   C    --->     A   y
+         / \                   / \
+        A   B                 B   C
+
+The API is the same as the one for BST's (insert, search, remove, predecessor, sucessor, kth smallest, valid range), so we may
+switch from one structure to the other by changing only the type. As for BST's, equal keys go to the left on insertion; but 
+notice that rotations may move an equal key to the right subtree, so in an AVL tree we only have left <= node <= right. 
+
+Each node also stores the number of nodes of its subtree (its "size"). Like the height, the size of a node depends only on its
+children, so it is fixed in the same places where the height is: when a node is created, after a rotation and on the way back 
+from an insertion or a remotion. With the sizes, an AVL is an "order statistic tree": the k-th smallest key, the rank of a key
+and the number of keys in a range are found in O(logn) time, and the number of nodes in O(1) (see the end of this section). 
+For the same reason, each node stores the sum of the keys of its subtree (BST_sum, computed once and for all), which gives sums 
+over ranges in O(logn) time. */
+
+typedef struct avl_node{
+    int key;
+    int height;
+    int size;
+    long long sum;
+    struct avl_node *left, *right;
+}AVL;
+
+AVL *AVL_initialize(){
+    return NULL;
+}
+
+int AVL_height(AVL *a){
+    if(a) return a->height;
     return 0;
-} 
\ No newline at end of file
+}
+
+int AVL_size(AVL *a){
+    if(a) return a->size;
+    return 0;
+}
+
+long long AVL_sum(AVL *a){
+    if(a) return a->sum;
+    return 0;
+}
+
+void AVL_update_node(AVL *a){
+    int hl = AVL_height(a->left), hr = AVL_height(a->right);
+    a->height = 1 + (hl > hr ? hl : hr);
+    a->size = 1 + AVL_size(a->left) + AVL_size(a->right);
+    a->sum = a->key + AVL_sum(a->left) + AVL_sum(a->right);
+}
+
+AVL *AVL_create_node(int n, AVL *left, AVL *right){
+    AVL *new_node = (AVL*)malloc(sizeof(AVL));
+    new_node->key = n;
+    new_node->left = left;
+    new_node->right = right;
+    AVL_update_node(new_node);
+    return new_node;
+}
+
+AVL *AVL_rotate_right(AVL *y){
+    AVL *x = y->left;
+    y->left = x->right;
+    x->right = y;
+    AVL_update_node(y);
+    AVL_update_node(x);
+    return x;
+}
+
+AVL *AVL_rotate_left(AVL *x){
+    AVL *y = x->right;
+    x->right = y->left;
+    y->left = x;
+    AVL_update_node(x);
+    AVL_update_node(y);
+    return y;
+}
+
+/* The next function is called on each node of the path from a modified leaf to the root. The subtrees of a are already 
+balanced, and their heights differ by at most 2. If the left subtree is the taller one and its own left subtree is not smaller 
+than its right one (the "left-left" case), a right rotation is enough. If the taller grandchild is the inner one (the "left-right" 
+case), we first rotate the child to the left, which reduces to the previous case. The right side is symmetric. */
+
+AVL *AVL_rebalance(AVL *a){
+    AVL_update_node(a);
+    int balance = AVL_height(a->left) - AVL_height(a->right);
+    if(balance > 1){
+        if(AVL_height(a->left->left) < AVL_height(a->left->right)) a->left = AVL_rotate_left(a->left);
+        return AVL_rotate_right(a);
+    }
+    if(balance < -1){
+        if(AVL_height(a->right->right) < AVL_height(a->right->left)) a->right = AVL_rotate_right(a->right);
+        return AVL_rotate_left(a);
+    }
+    return a;
+}
+
+AVL *AVL_insert(AVL *a, int n){
+    if(!a) return AVL_create_node(n,NULL,NULL);
+    if(n <= a->key) a->left = AVL_insert(a->left,n);
+    else a->right = AVL_insert(a->right,n);
+    return AVL_rebalance(a);
+}
+
+/* Since the height is O(logn), there is no risk in using recursion here; but the search is so simple that we write it 
+iteratively. */
+
+AVL *AVL_search(AVL *a, int n){
+    while(a && a->key != n){
+        if(n < a->key) a = a->left;
+        else a = a->right;
+    }
+    return a;
+}
+
+AVL *AVL_minimum(AVL *a){
+    if(a) while(a->left) a = a->left;
+    return a;
+}
+
+AVL *AVL_maximum(AVL *a){
+    if(a) while(a->right) a = a->right;
+    return a;
+}
+
+/* To remove a node with two children, we replace its key by the key of its sucessor (the minimum of the right subtree) 
+and remove the sucessor from the right subtree instead. Then, as in the insertion, every node on the way back is rebalanced. */
+
+AVL *AVL_remove(AVL *a, int n){
+    if(!a) return NULL;
+    if(n < a->key) a->left = AVL_remove(a->left,n);
+    else if(n > a->key) a->right = AVL_remove(a->right,n);
+    else{
+        if(!a->left || !a->right){
+            AVL *child = a->left ? a->left : a->right;
+            free(a);
+            return child;
+        }
+        AVL *suc = AVL_minimum(a->right);
+        a->key = suc->key;
+        a->right = AVL_remove(a->right,suc->key);
+    }
+    return AVL_rebalance(a);
+}
+
+AVL *AVL_free(AVL *a){
+    if(a){
+        AVL_free(a->left);
+        AVL_free(a->right);
+        free(a);
+    }
+    return NULL;
+}
+
+int AVL_number_of_nodes(AVL *a){
+    return AVL_size(a);
+}
+
+void AVL_print_inorder(AVL *a){
+    if(a){
+        AVL_print_inorder(a->left);
+        printf("%d--", a->key);
+        AVL_print_inorder(a->right);
+    }
+}
+
+/* The predecessor of n is the largest key smaller than n. Unlike BST_predecessor, we do not need n to be in the tree: we 
+walk from the root, and every time we go to the right we have found a better candidate. The sucessor is symmetric. Both run in
+O(logn) time. */
+
+AVL *AVL_predecessor(AVL *a, int n){
+    AVL *output = NULL;
+    while(a){
+        if(a->key < n){
+            output = a;
+            a = a->right;
+        }
+        else a = a->left;
+    }
+    return output;
+}
+
+AVL *AVL_sucessor(AVL *a, int n){
+    AVL *output = NULL;
+    while(a){
+        if(a->key > n){
+            output = a;
+            a = a->left;
+        }
+        else a = a->right;
+    }
+    return output;
+}
+
+/* The k-th smallest node. If the left subtree has k-1 nodes, the k-th smallest key is the root; if it has k nodes or more, it is
+in the left subtree; otherwise, it is the (k - size(left) - 1)-th smallest key of the right subtree. This is a single path from 
+the root, so it takes O(logn) time instead of the O(k) time of an in-order traversal. */
+
+AVL *AVL_kth(AVL *a, int k){
+    while(a){
+        int left_size = AVL_size(a->left);
+        if(k == left_size + 1) return a;
+        if(k <= left_size) a = a->left;
+        else{
+            k -= left_size + 1;
+            a = a->right;
+        }
+    }
+    return NULL;
+}
+
+/* Same signatures as BST_kth_smallest and BST_kth_largest: output receives the k-th smallest (largest) key and count, which 
+must be initialized with 0, receives the number of keys counted (k, or the number of nodes if the tree has less than k nodes). */
+
+void AVL_kth_smallest(AVL *a, int k, int *count, int *output){
+    AVL *node = AVL_kth(a,k - *count);
+    if(node){
+        *output = node->key;
+        *count = k;
+    }
+    else *count += AVL_size(a);
+}
+
+void AVL_kth_largest(AVL *a, int k, int *count, int *output){
+    int remaining = k - *count;
+    AVL *node = remaining >= 1 ? AVL_kth(a,AVL_size(a) - remaining + 1) : NULL;
+    if(node){
+        *output = node->key;
+        *count = k;
+    }
+    else *count += AVL_size(a);
+}
+
+/* The next function builds a balanced AVL from a sorted vector, exactly as VET2BST does for BST's, but without copying
+the subvectors: the middle element is the root, and the two halves are the subtrees. Heights are set as we come back. */
+
+AVL *VET2AVL(int *vet, int n){
+    if(n <= 0) return NULL;
+    int mid = n/2;
+    return AVL_create_node(vet[mid],VET2AVL(vet,mid),VET2AVL(&vet[mid+1],n-mid-1));
+}
+
+void AVL2VET_in_range(AVL *a, int min, int max, int *vet, int *size){
+    if(a){
+        if(a->key >= min) AVL2VET_in_range(a->left,min,max,vet,size);
+        if(a->key >= min && a->key <= max) vet[(*size)++] = a->key;
+        if(a->key <= max) AVL2VET_in_range(a->right,min,max,vet,size);
+    }
+}
+
+/* Pruning the tree as BST_valid_range does would break the balance. Instead, we put the keys lying in [min,max] in a sorted 
+vector (visiting only the subtrees that may contain them), free the tree and rebuild it with VET2AVL. This is O(n). */
+
+AVL *AVL_valid_range(AVL *a, int min, int max){
+    int n = AVL_number_of_nodes(a), size = 0;
+    int *vet = (int*)malloc((n+1)*sizeof(int));
+    AVL2VET_in_range(a,min,max,vet,&size);
+    AVL_free(a);
+    a = VET2AVL(vet,size);
+    free(vet);
+    return a;
+}
+
+/* ORDER STATISTICS. The rank of n is the number of keys lesser than n. We go down as in a search: every time we go to the 
+right, the current node and its whole left subtree are lesser than n, so we add them. The number of keys lesser than or equal 
+to n is computed in the same way, and the number of keys in [min,max] is the difference between the two. */
+
+int AVL_rank(AVL *a, int n){
+    int rank = 0;
+    while(a){
+        if(a->key < n){
+            rank += AVL_size(a->left) + 1;
+            a = a->right;
+        }
+        else a = a->left;
+    }
+    return rank;
+}
+
+int AVL_count_lesser_or_equal(AVL *a, int n){
+    int count = 0;
+    while(a){
+        if(a->key <= n){
+            count += AVL_size(a->left) + 1;
+            a = a->right;
+        }
+        else a = a->left;
+    }
+    return count;
+}
+
+int AVL_count_in_range(AVL *a, int min, int max){
+    if(min > max) return 0;
+    return AVL_count_lesser_or_equal(a,max) - AVL_rank(a,min);
+}
+
+/* RANGE QUERIES. The functions below work on half-open ranges [low,high), which can be split and joined without gaps or
+overlaps: [a,b) and [b,c) give [a,c). The sum of the keys lesser than n is computed exactly as the rank, adding sums instead of
+sizes; the sum (and the number) of the keys in [low,high) is then a difference, in O(logn) time. The minimum of the range is 
+the first key >= low and the maximum is the predecessor of high, so no augmentation is needed for them. */
+
+long long AVL_sum_lesser_than(AVL *a, int n){
+    long long sum = 0;
+    while(a){
+        if(a->key < n){
+            sum += AVL_sum(a->left) + a->key;
+            a = a->right;
+        }
+        else a = a->left;
+    }
+    return sum;
+}
+
+long long AVL_range_sum(AVL *a, int low, int high){
+    if(low >= high) return 0;
+    return AVL_sum_lesser_than(a,high) - AVL_sum_lesser_than(a,low);
+}
+
+int AVL_range_count(AVL *a, int low, int high){
+    if(low >= high) return 0;
+    return AVL_rank(a,high) - AVL_rank(a,low);
+}
+
+AVL *AVL_lower_bound(AVL *a, int n){
+    AVL *output = NULL;
+    while(a){
+        if(a->key >= n){
+            output = a;
+            a = a->left;
+        }
+        else a = a->right;
+    }
+    return output;
+}
+
+AVL *AVL_range_min(AVL *a, int low, int high){
+    AVL *node = AVL_lower_bound(a,low);
+    if(node && node->key < high) return node;
+    return NULL;
+}
+
+AVL *AVL_range_max(AVL *a, int low, int high){
+    AVL *node = AVL_predecessor(a,high);
+    if(node && node->key >= low) return node;
+    return NULL;
+}
+
+/* To visit the keys of [low,high) in order, we do not need to walk the whole tree. We go down from the root towards low, 
+stacking every node whose key is >= low (as we go to its left subtree): the stack is then exactly the one an in-order 
+traversal would have just before visiting the first key >= low. From there, each step pops a node and stacks the left path of
+its right subtree, and we stop at the first key >= high. The whole iteration takes O(logn + k) time for k keys, and can be paused
+and resumed as the iterators for BST's. An AVL with less than 2^31 nodes has height at most 45, so a vector of AVL_MAX_HEIGHT 
+pointers inside the iterator is always enough. */
+
+#define AVL_MAX_HEIGHT 48
+
+typedef struct avl_range_iterator{
+    AVL *stack[AVL_MAX_HEIGHT];
+    int top;
+    int high;
+}AVLRI; /* AVLRI stands for AVL Range Iterator */
+
+void AVLRI_initialize(AVLRI *it, AVL *a, int low, int high){
+    it->top = 0;
+    it->high = high;
+    while(a){
+        if(a->key >= low){
+            it->stack[it->top++] = a;
+            a = a->left;
+        }
+        else a = a->right;
+    }
+}
+
+AVL *AVLRI_next(AVLRI *it){
+    if(it->top == 0) return NULL;
+    AVL *output = it->stack[--it->top], *aux;
+    if(output->key >= it->high){
+        it->top = 0;
+        return NULL;
+    }
+    for(aux = output->right; aux; aux = aux->left) it->stack[it->top++] = aux;
+    return output;
+}
+
+/* Finally, a function which checks that a given tree is an AVL: keys are ordered, stored heights, sizes and sums are correct 
+and every node is balanced. It returns the height of the tree, or -1 if some property fails. */
+
+int AVL_check(AVL *a, int min, int max){
+    if(!a) return 0;
+    if(a->key < min || a->key > max) return -1;
+    int hl = AVL_check(a->left,min,a->key), hr = AVL_check(a->right,a->key,max);
+    if(hl < 0 || hr < 0 || hl-hr > 1 || hr-hl > 1) return -1;
+    if(a->height != 1 + (hl > hr ? hl : hr)) return -1;
+    if(a->size != 1 + AVL_size(a->left) + AVL_size(a->right)) return -1;
+    if(a->sum != a->key + AVL_sum(a->left) + AVL_sum(a->right)) return -1;
+    return a->height;
+}
+
+/* END OF AVL TREES */
+
+/* B+ TREES */
+
+/* Even when it is balanced, a BST wastes the memory hierarchy. Each node holds a single key and two pointers, and nodes are 
+scattered in the heap, so a search in a tree with n keys touches about log2(n) different cache lines: for one million keys this 
+is about 20 cache misses per lookup. 
+
+A B+ tree stores many keys per node. Internal nodes contain up to BPT_MAX_KEYS sorted separators and BPT_MAX_KEYS+1 children;
+all the keys are stored in the leaves, which are linked in a doubly linked list (so a range scan is just a walk along the 
+leaves). With 32 keys per node, a node's key array fills exactly two cache lines, the tree has height about log33(n) (four levels
+for one million keys), and the search inside each node is a short scan over contiguous memory.
+
+The rule for separators is: if keys[i] is the i-th separator of an internal node, then every key in children[i] is smaller than 
+keys[i], and every key in children[i+1] is greater than or equal to it (in fact, keys[i] is the smallest key under children[i+1]).
+Hence, to look for n we go down to the child whose index is the number of separators lesser than or equal to n.
+
+To answer k-th smallest queries in O(logn) time, each internal node also stores the number of keys in each of its children. 
+
+Unlike the BST's above, a B+ tree is an index: keys are distinct, and inserting a key which is already there does nothing. 
+Leaves and internal nodes have different structures, so a child pointer is a void pointer and we use the height of the tree to 
+know, while descending, whether the children of a node are leaves. The key array is the first field of both structures, so it 
+starts at the (16-byte aligned) address returned by malloc. */
+
+#define BPT_MAX_KEYS 32
+
+typedef struct bpt_leaf{
+    int keys[BPT_MAX_KEYS];
+    int num_keys;
+    struct bpt_leaf *prev, *next;
+}BPL; /* BPL stands for B+ tree Leaf */
+
+typedef struct bpt_internal{
+    int keys[BPT_MAX_KEYS];
+    int num_keys;
+    int sizes[BPT_MAX_KEYS+1];
+    void *children[BPT_MAX_KEYS+1];
+}BPI; /* BPI stands for B+ tree Internal node */
+
+typedef struct bplus_tree{
+    void *root;
+    int height; /* number of internal levels; 0 means that the root is a leaf */
+    int size;
+    BPL *first, *last;
+}BPT;
+
+BPT *BPT_initialize(){
+    BPT *t = (BPT*)malloc(sizeof(BPT));
+    t->root = NULL;
+    t->height = 0;
+    t->size = 0;
+    t->first = t->last = NULL;
+    return t;
+}
+
+BPL *BPL_create(){
+    BPL *l = (BPL*)malloc(sizeof(BPL));
+    l->num_keys = 0;
+    l->prev = l->next = NULL;
+    return l;
+}
+
+BPI *BPI_create(){
+    BPI *node = (BPI*)malloc(sizeof(BPI));
+    node->num_keys = 0;
+    return node;
+}
+
+void BPT_free_node(void *node, int height){
+    if(height > 0){
+        BPI *in = (BPI*)node;
+        int i;
+        for(i = 0; i <= in->num_keys; i++) BPT_free_node(in->children[i],height-1);
+    }
+    free(node);
+}
+
+BPT *BPT_free(BPT *t){
+    if(t){
+        if(t->root) BPT_free_node(t->root,t->height);
+        free(t);
+    }
+    return NULL;
+}
+
+/* Searching inside a node. The first kind of function returns the number of keys lesser than n (that is, the position where n 
+is, or would be inserted) and the second one returns the number of keys lesser than or equal to n. Since a node is small and its
+keys are contiguous, a linear count without early exit is faster than a binary search: there is no branch to mispredict. */
+
+int BPT_node_lower_bound_scalar(int *keys, int num_keys, int n){
+    int i, count = 0;
+    for(i = 0; i < num_keys; i++) count += keys[i] < n;
+    return count;
+}
+
+int BPT_node_upper_bound_scalar(int *keys, int num_keys, int n){
+    int i, count = 0;
+    for(i = 0; i < num_keys; i++) count += keys[i] <= n;
+    return count;
+}
+
+/* On x86 processors we can do better with SIMD instructions. We copy n to every lane of a vector register and compare it with 
+4 (SSE2) or 8 (AVX2) keys at once; "movemask" packs the results of the comparisons into the bits of an integer, and the answer is
+the number of bits set. We always compare the whole key array (BPT_MAX_KEYS is a multiple of 8 smaller than 64, and the 
+positions after num_keys are inside the node, even if they hold garbage) and then clear the bits of the positions after num_keys.
+So there is no loop depending on num_keys and no branch at all: 32 keys cost 4 AVX2 comparisons.
+
+For the upper bound we count the keys greater than n and subtract from num_keys, which avoids the special case n = INT_MAX.
+
+Not every processor has AVX2, so the AVX2 functions are compiled for that instruction set only (with the target attribute) and
+we choose, when the program starts, which functions to use according to what the processor reports (the CPUID instruction, 
+wrapped by __builtin_cpu_supports). The chosen functions are stored in the two function pointers below, which are called with
+the same syntax as ordinary functions. */
+
+int (*BPT_node_lower_bound)(int *keys, int num_keys, int n) = BPT_node_lower_bound_scalar;
+int (*BPT_node_upper_bound)(int *keys, int num_keys, int n) = BPT_node_upper_bound_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2"))) int BPT_node_lower_bound_sse2(int *keys, int num_keys, int n){
+    __m128i needle = _mm_set1_epi32(n);
+    unsigned long long mask = 0;
+    int i;
+    for(i = 0; i < BPT_MAX_KEYS; i += 4){
+        __m128i block = _mm_loadu_si128((__m128i*)&keys[i]);
+        mask |= (unsigned long long)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(needle,block))) << i;
+    }
+    return __builtin_popcountll(mask & ((1ULL << num_keys) - 1));
+}
+
+__attribute__((target("sse2"))) int BPT_node_upper_bound_sse2(int *keys, int num_keys, int n){
+    __m128i needle = _mm_set1_epi32(n);
+    unsigned long long mask = 0;
+    int i;
+    for(i = 0; i < BPT_MAX_KEYS; i += 4){
+        __m128i block = _mm_loadu_si128((__m128i*)&keys[i]);
+        mask |= (unsigned long long)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block,needle))) << i;
+    }
+    return num_keys - __builtin_popcountll(mask & ((1ULL << num_keys) - 1));
+}
+
+__attribute__((target("avx2,popcnt"))) int BPT_node_lower_bound_avx2(int *keys, int num_keys, int n){
+    __m256i needle = _mm256_set1_epi32(n);
+    unsigned long long mask = 0;
+    int i;
+    for(i = 0; i < BPT_MAX_KEYS; i += 8){
+        __m256i block = _mm256_loadu_si256((__m256i*)&keys[i]);
+        mask |= (unsigned long long)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle,block))) << i;
+    }
+    return __builtin_popcountll(mask & ((1ULL << num_keys) - 1));
+}
+
+__attribute__((target("avx2,popcnt"))) int BPT_node_upper_bound_avx2(int *keys, int num_keys, int n){
+    __m256i needle = _mm256_set1_epi32(n);
+    unsigned long long mask = 0;
+    int i;
+    for(i = 0; i < BPT_MAX_KEYS; i += 8){
+        __m256i block = _mm256_loadu_si256((__m256i*)&keys[i]);
+        mask |= (unsigned long long)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(block,needle))) << i;
+    }
+    return num_keys - __builtin_popcountll(mask & ((1ULL << num_keys) - 1));
+}
+
+#endif
+
+/* Chooses the in-node search: "scalar", "sse2", "avx2", or NULL for the best one the processor supports. Returns the name of 
+the chosen kernel, or NULL if the requested one is not available. */
+
+const char *BPT_select_node_search(const char *name){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if((!name || strcmp(name,"avx2") == 0) && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")){
+        BPT_node_lower_bound = BPT_node_lower_bound_avx2;
+        BPT_node_upper_bound = BPT_node_upper_bound_avx2;
+        return "avx2";
+    }
+    if((!name || strcmp(name,"sse2") == 0) && __builtin_cpu_supports("sse2")){
+        BPT_node_lower_bound = BPT_node_lower_bound_sse2;
+        BPT_node_upper_bound = BPT_node_upper_bound_sse2;
+        return "sse2";
+    }
+#endif
+    if(!name || strcmp(name,"scalar") == 0){
+        BPT_node_lower_bound = BPT_node_lower_bound_scalar;
+        BPT_node_upper_bound = BPT_node_upper_bound_scalar;
+        return "scalar";
+    }
+    return NULL;
+}
+
+/* The leaf where n is (or would be): at each level we go to the child whose index is the number of separators <= n. */
+
+BPL *BPT_find_leaf(BPT *t, int n){
+    void *node = t->root;
+    int level;
+    if(!node) return NULL;
+    for(level = t->height; level > 0; level--){
+        BPI *in = (BPI*)node;
+        node = in->children[BPT_node_upper_bound(in->keys,in->num_keys,n)];
+    }
+    return (BPL*)node;
+}
+
+/* As BST_search returns the node containing n, BPT_search returns the address of n inside its leaf, or NULL. */
+
+int *BPT_search(BPT *t, int n){
+    BPL *l = BPT_find_leaf(t,n);
+    if(!l) return NULL;
+    int pos = BPT_node_lower_bound(l->keys,l->num_keys,n);
+    if(pos < l->num_keys && l->keys[pos] == n) return &l->keys[pos];
+    return NULL;
+}
+
+/* The predecessor (largest key lesser than n) is just before the position of n in its leaf; if n would be the first key of the
+leaf, then it is the last key of the previous leaf. The sucessor is symmetric. As for AVL trees, n does not need to be in the tree. */
+
+int *BPT_predecessor(BPT *t, int n){
+    BPL *l = BPT_find_leaf(t,n);
+    if(!l) return NULL;
+    int pos = BPT_node_lower_bound(l->keys,l->num_keys,n);
+    if(pos > 0) return &l->keys[pos-1];
+    if(l->prev) return &l->prev->keys[l->prev->num_keys-1];
+    return NULL;
+}
+
+int *BPT_sucessor(BPT *t, int n){
+    BPL *l = BPT_find_leaf(t,n);
+    if(!l) return NULL;
+    int pos = BPT_node_upper_bound(l->keys,l->num_keys,n);
+    if(pos < l->num_keys) return &l->keys[pos];
+    if(l->next) return &l->next->keys[0];
+    return NULL;
+}
+
+/* The k-th smallest key (k from 1 to the number of keys) is found with the sizes stored in the internal nodes: we skip the 
+children whose keys are all among the k-1 smallest ones. */
+
+int *BPT_kth_smallest(BPT *t, int k){
+    if(k < 1 || k > t->size) return NULL;
+    void *node = t->root;
+    int level, i;
+    for(level = t->height; level > 0; level--){
+        BPI *in = (BPI*)node;
+        i = 0;
+        while(k > in->sizes[i]){
+            k -= in->sizes[i];
+            i++;
+        }
+        node = in->children[i];
+    }
+    return &((BPL*)node)->keys[k-1];
+}
+
+int BPT_number_of_keys(BPT *t){
+    return t->size;
+}
+
+int BPT_node_size(void *node, int height){
+    if(height == 0) return ((BPL*)node)->num_keys;
+    BPI *in = (BPI*)node;
+    int i, size = 0;
+    for(i = 0; i <= in->num_keys; i++) size += in->sizes[i];
+    return size;
+}
+
+/* INSERTION. We go down to the leaf and insert the key there. If the leaf is full, we first split it in two halves (the new 
+right half is linked after it in the list of leaves) and insert the key in the correct half; the smallest key of the right 
+half must then be inserted as a separator in the parent, together with the pointer to the new leaf. This may split the parent 
+as well, and so on. When the root splits, a new root with a single separator is created and the height grows by one. 
+
+The recursive function below returns the new right sibling of the node if it split (and NULL otherwise), and stores in up_key 
+the separator for that sibling. When an internal node with keys k0,...,k(M-1) and children c0,...,cM splits, the left half
+keeps k0,...,k(h-1) and c0,...,ch, the separator kh goes up, and the right half receives k(h+1),...,k(M-1) and c(h+1),...,cM. */
+
+void *BPT_insert_rec(void *node, int height, int n, int *up_key, int *inserted){
+    int i;
+    if(height == 0){
+        BPL *l = (BPL*)node, *target = l, *right = NULL;
+        int pos = BPT_node_lower_bound(l->keys,l->num_keys,n);
+        if(pos < l->num_keys && l->keys[pos] == n){
+            *inserted = 0;
+            return NULL;
+        }
+        *inserted = 1;
+        if(l->num_keys == BPT_MAX_KEYS){
+            int half = BPT_MAX_KEYS/2;
+            right = BPL_create();
+            for(i = half; i < BPT_MAX_KEYS; i++) right->keys[i-half] = l->keys[i];
+            right->num_keys = BPT_MAX_KEYS - half;
+            l->num_keys = half;
+            right->next = l->next;
+            right->prev = l;
+            if(l->next) l->next->prev = right;
+            l->next = right;
+            if(pos > half){
+                target = right;
+                pos -= half;
+            }
+        }
+        for(i = target->num_keys; i > pos; i--) target->keys[i] = target->keys[i-1];
+        target->keys[pos] = n;
+        target->num_keys++;
+        if(right) *up_key = right->keys[0];
+        return right;
+    }
+
+    BPI *in = (BPI*)node, *target = in, *right = NULL;
+    int idx = BPT_node_upper_bound(in->keys,in->num_keys,n), child_key;
+    void *child_right = BPT_insert_rec(in->children[idx],height-1,n,&child_key,inserted);
+    if(*inserted) in->sizes[idx]++;
+    if(!child_right) return NULL;
+
+    int right_size = BPT_node_size(child_right,height-1);
+    in->sizes[idx] -= right_size;
+    if(in->num_keys == BPT_MAX_KEYS){
+        int half = BPT_MAX_KEYS/2;
+        right = BPI_create();
+        *up_key = in->keys[half];
+        for(i = half+1; i < BPT_MAX_KEYS; i++) right->keys[i-half-1] = in->keys[i];
+        for(i = half+1; i <= BPT_MAX_KEYS; i++){
+            right->children[i-half-1] = in->children[i];
+            right->sizes[i-half-1] = in->sizes[i];
+        }
+        right->num_keys = BPT_MAX_KEYS - half - 1;
+        in->num_keys = half;
+        if(idx > half){
+            target = right;
+            idx -= half+1;
+        }
+    }
+    for(i = target->num_keys; i > idx; i--){
+        target->keys[i] = target->keys[i-1];
+        target->children[i+1] = target->children[i];
+        target->sizes[i+1] = target->sizes[i];
+    }
+    target->keys[idx] = child_key;
+    target->children[idx+1] = child_right;
+    target->sizes[idx+1] = right_size;
+    target->num_keys++;
+    return right;
+}
+
+/* Returns 1 if n was inserted and 0 if it was already in the tree. */
+
+int BPT_insert(BPT *t, int n){
+    int up_key, inserted;
+    if(!t->root){
+        BPL *l = BPL_create();
+        l->keys[0] = n;
+        l->num_keys = 1;
+        t->root = t->first = t->last = l;
+        t->size = 1;
+        return 1;
+    }
+    void *right = BPT_insert_rec(t->root,t->height,n,&up_key,&inserted);
+    if(right){
+        BPI *new_root = BPI_create();
+        new_root->keys[0] = up_key;
+        new_root->num_keys = 1;
+        new_root->children[0] = t->root;
+        new_root->children[1] = right;
+        new_root->sizes[0] = BPT_node_size(t->root,t->height);
+        new_root->sizes[1] = BPT_node_size(right,t->height);
+        t->root = new_root;
+        t->height++;
+    }
+    if(t->height == 0) t->last = (BPL*)t->root;
+    else if(t->last->next) t->last = t->last->next;
+    t->size += inserted;
+    return inserted;
+}
+
+/* BULK LOADING. Building the tree from a sorted vector by repeated insertions would leave every leaf half full. Instead, we 
+build it bottom-up in O(n) time: the keys are spread evenly over the minimum number of leaves; then the leaves are grouped 
+evenly under the minimum number of internal nodes, and so on until a single node (the root) remains. While building a level we 
+keep, for each of its nodes, the smallest key below it (which is the separator in the parent) and its number of keys. Repeated 
+keys in the input vector are skipped. */
+
+BPT *BPT_bulk_load(int *vet, int n){
+    BPT *t = BPT_initialize();
+    int *keys = (int*)malloc((n+1)*sizeof(int));
+    int i, j, m = 0;
+    for(i = 0; i < n; i++) if(m == 0 || vet[i] != keys[m-1]) keys[m++] = vet[i];
+    if(m == 0){
+        free(keys);
+        return t;
+    }
+
+    int count = (m + BPT_MAX_KEYS - 1) / BPT_MAX_KEYS;
+    void **level = (void**)malloc(count*sizeof(void*));
+    int *mins = (int*)malloc(count*sizeof(int));
+    int *sizes = (int*)malloc(count*sizeof(int));
+    BPL *prev = NULL;
+    for(j = 0; j < count; j++){
+        int begin = (int)((long long)j*m/count), end = (int)((long long)(j+1)*m/count);
+        BPL *l = BPL_create();
+        for(i = begin; i < end; i++) l->keys[i-begin] = keys[i];
+        l->num_keys = end - begin;
+        l->prev = prev;
+        if(prev) prev->next = l;
+        else t->first = l;
+        prev = l;
+        level[j] = l;
+        mins[j] = keys[begin];
+        sizes[j] = end - begin;
+    }
+    t->last = prev;
+
+    while(count > 1){
+        int parents = (count + BPT_MAX_KEYS) / (BPT_MAX_KEYS + 1);
+        for(j = 0; j < parents; j++){
+            int begin = (int)((long long)j*count/parents), end = (int)((long long)(j+1)*count/parents), total = 0;
+            BPI *in = BPI_create();
+            for(i = begin; i < end; i++){
+                in->children[i-begin] = level[i];
+                in->sizes[i-begin] = sizes[i];
+                if(i > begin) in->keys[i-begin-1] = mins[i];
+                total += sizes[i];
+            }
+            in->num_keys = end - begin - 1;
+            level[j] = in;
+            mins[j] = mins[begin];
+            sizes[j] = total;
+        }
+        count = parents;
+        t->height++;
+    }
+    t->root = level[0];
+    t->size = m;
+    free(level);
+    free(mins);
+    free(sizes);
+    free(keys);
+    return t;
+}
+
+/* RANGE QUERIES. To list the keys in [min,max], we find the leaf of min and walk along the linked leaves until a key greater 
+than max appears. This takes O(logn + k) time, where k is the number of reported keys, and touches only about k/BPT_MAX_KEYS 
+leaves. The function writes at most capacity keys in output and returns the number of keys in the range. */
+
+int BPT_range(BPT *t, int min, int max, int *output, int capacity){
+    BPL *l = BPT_find_leaf(t,min);
+    int count = 0, pos;
+    if(!l || min > max) return 0;
+    pos = BPT_node_lower_bound(l->keys,l->num_keys,min);
+    while(l){
+        for(; pos < l->num_keys; pos++){
+            if(l->keys[pos] > max) return count;
+            if(count < capacity) output[count] = l->keys[pos];
+            count++;
+        }
+        l = l->next;
+        pos = 0;
+    }
+    return count;
+}
+
+/* As BST_valid_range, the next function keeps only the keys in [min,max]. We collect them with a range scan and bulk load a 
+new tree, which is O(n) time and leaves all the nodes full. */
+
+BPT *BPT_valid_range(BPT *t, int min, int max){
+    int *keys = (int*)malloc((t->size+1)*sizeof(int));
+    int m = BPT_range(t,min,max,keys,t->size);
+    BPT_free(t);
+    t = BPT_bulk_load(keys,m);
+    free(keys);
+    return t;
+}
+
+void BPT_print(BPT *t){
+    BPL *l = t->first;
+    int i;
+    while(l){
+        for(i = 0; i < l->num_keys; i++) printf("%d--", l->keys[i]);
+        l = l->next;
+    }
+}
+
+/* END OF B+ TREES */
+
+/* STATIC LAYOUTS -- EYTZINGER AND VAN EMDE BOAS */
+
+/* When a set of keys is built once and then only queried, we do not need pointers at all: the tree can be stored implicitly in
+an array, where the position of a node determines the positions of its children. "Freezing" a BST means copying its keys, in 
+sorted order, into such an array.
+
+In the Eytzinger layout (the one used for binary heaps) the root is at position 1 and the children of position k are at 2k and 
+2k+1; the keys are placed so that an in-order traversal of this implicit tree gives the sorted sequence. To search for the first 
+key >= x, we go down with k = 2k + (keys[k] < x), which is an addition and not a branch, so the processor never mispredicts it. 
+When k falls off the tree, the path taken is written in its binary digits: each 1 is a step to the right and each 0 a step to
+the left. The answer is the last node where we went left, so we remove the trailing 1's and the last 0 (a shift by __builtin_ffs(~k)),
+and we get 0 if the answer does not exist.
+
+The 16 descendants of k four levels below are at positions 16k to 16k+15, which is one cache line of ints if the array is 
+aligned to 64 bytes. So at each step we ask the processor to prefetch that line: when the search gets there, four steps later,
+the keys are already in cache. In the last four levels 16k is past the end of the array, and a pointer past the end is not 
+valid even as a prefetch address, so the position is computed in size_t and clamped to n.
+
+Positions are ints and the search goes down to 2n+1, so the arrays hold less than 2^30 keys (EYT_from_sorted_array returns 
+NULL otherwise).
+
+Since the same n keys may be queried with several kinds of questions, we also keep, for each position, the rank of its key 
+(its position in sorted order), so that the rank of x (the number of keys lesser than x) is read directly from the result of a 
+lower bound. */
+
+typedef struct eytzinger_array{
+    int *keys;  /* keys[1..n] in Eytzinger order */
+    int *ranks; /* ranks[k] is the number of keys before keys[k] in sorted order */
+    int n;
+}EYT;
+
+/* We first need the keys of the BST in sorted order. A recursive traversal would need as many nested calls as the height of
+the tree (that is, n calls for a degenerate tree), so we use the Morris traversal: when a node has a left subtree, the right 
+pointer of its predecessor (which is NULL, since the predecessor is the maximum of the left subtree) is temporarily pointed back 
+to the node, so that we can come back without a stack. The second visit to the node removes this link, so the tree is restored 
+at the end. The function writes the keys in output (if it is not NULL) and returns the number of nodes, in O(n) time and O(1) 
+space. */
+
+int BST_inorder_to_array(BST *b, int *output){
+    int count = 0;
+    while(b){
+        if(!b->left){
+            if(output) output[count] = b->key;
+            count++;
+            b = b->right;
+        }
+        else{
+            BST *pre = b->left;
+            while(pre->right && pre->right != b) pre = pre->right;
+            if(!pre->right){
+                pre->right = b;
+                b = b->left;
+            }
+            else{
+                pre->right = NULL;
+                if(output) output[count] = b->key;
+                count++;
+                b = b->right;
+            }
+        }
+    }
+    return count;
+}
+
+int *aligned_int_array(int size){
+    size_t bytes = ((size_t)size*sizeof(int) + 63) / 64 * 64;
+    return (int*)aligned_alloc(64,bytes ? bytes : 64);
+}
+
+/* Fills the subtree rooted at position k with the next keys of the sorted vector, in in-order. */
+
+void EYT_fill(EYT *e, int *sorted, int *next, int k){
+    if(k <= e->n){
+        EYT_fill(e,sorted,next,2*k);
+        e->keys[k] = sorted[*next];
+        e->ranks[k] = *next;
+        (*next)++;
+        EYT_fill(e,sorted,next,2*k+1);
+    }
+}
+
+#define EYT_MAX_SIZE ((1 << 30) - 1)
+
+EYT *EYT_from_sorted_array(int *sorted, int n){
+    if(n > EYT_MAX_SIZE) return NULL;
+    EYT *e = (EYT*)malloc(sizeof(EYT));
+    int next = 0;
+    e->n = n;
+    e->keys = aligned_int_array(n+1);
+    e->ranks = (int*)malloc((n+1)*sizeof(int));
+    EYT_fill(e,sorted,&next,1);
+    return e;
+}
+
+EYT *BST_freeze(BST *b){
+    int n = BST_inorder_to_array(b,NULL);
+    int *sorted = (int*)malloc((n+1)*sizeof(int));
+    BST_inorder_to_array(b,sorted);
+    EYT *e = EYT_from_sorted_array(sorted,n);
+    free(sorted);
+    return e;
+}
+
+EYT *EYT_free(EYT *e){
+    if(e){
+        free(e->keys);
+        free(e->ranks);
+        free(e);
+    }
+    return NULL;
+}
+
+/* The position of the first key >= x (lower bound) and of the first key > x (upper bound), or 0 if there is none. */
+
+int EYT_lower_bound(EYT *e, int x){
+    int k = 1;
+    while(k <= e->n){
+        size_t ahead = 16*(size_t)k;
+        __builtin_prefetch(e->keys + (ahead < (size_t)e->n ? ahead : (size_t)e->n));
+        k = 2*k + (e->keys[k] < x);
+    }
+    return k >> __builtin_ffs(~k);
+}
+
+int EYT_upper_bound(EYT *e, int x){
+    int k = 1;
+    while(k <= e->n){
+        size_t ahead = 16*(size_t)k;
+        __builtin_prefetch(e->keys + (ahead < (size_t)e->n ? ahead : (size_t)e->n));
+        k = 2*k + (e->keys[k] <= x);
+    }
+    return k >> __builtin_ffs(~k);
+}
+
+int EYT_rank(EYT *e, int x){
+    int k = EYT_lower_bound(e,x);
+    return k ? e->ranks[k] : e->n;
+}
+
+int *EYT_search(EYT *e, int x){
+    int k = EYT_lower_bound(e,x);
+    if(k && e->keys[k] == x) return &e->keys[k];
+    return NULL;
+}
+
+/* The Eytzinger layout is excellent for the first levels of the tree (they share a few cache lines), but below them each step
+goes to a different line. The van Emde Boas (vEB) layout fixes that at every scale. Consider a complete tree of height h. We cut 
+it at half of its height: a top tree of height h/2 and 2^(h/2) bottom trees. The top tree is stored first, then each bottom 
+tree, from left to right, and each of these trees is stored recursively in the same way. So every subtree of height about 
+log2(B) lies in a contiguous block, for any block size B: a search touches O(log_B(n)) blocks, whatever the size of the cache 
+line or of the page. This is what is called a "cache-oblivious" layout.
+
+The layout needs a complete tree, so we pad the sorted keys with INT_MAX up to 2^h - 1 keys. Padding keys are never smaller 
+than any key, so they do not change the answers; their rank is n.
+
+To go down the tree we do not compute positions from scratch. We keep the index k of the node as in the Eytzinger numbering and, 
+for each depth d, the vEB position pos[d] of the node at depth d of the current path. When the recursive cut makes depth d the 
+root level of bottom trees, let D[d] be the depth of the root of the corresponding top tree, T[d] the size of that top tree and
+B[d] the size of each bottom tree. The bottom trees hanging from the top tree rooted at pos[D[d]] are stored right after it, and 
+our bottom tree is the one whose number is given by the last d - D[d] binary digits of k. Hence
+
+pos[d] = pos[D[d]] + T[d] + (k mod 2^(d-D[d])) * B[d].
+
+(Here d - D[d] is the height of that top tree.)
+
+The values D, T, B and 2^(d-D[d]) - 1 depend only on the depth, so they are computed once and stored together (the four of 
+them are read at each step of a search). */
+
+/* The padded tree has 2^h - 1 keys, which must be a valid size for the Eytzinger array, so the height is at most 30. */
+
+#define VEB_MAX_HEIGHT 30
+
+typedef struct veb_level{
+    int top_depth, top_size, bottom_size, mask;
+}VEBL;
+
+typedef struct veb_array{
+    int *keys;
+    int *ranks;
+    int n, height;
+    VEBL levels[VEB_MAX_HEIGHT+1];
+}VEB;
+
+void VEB_tables(VEB *v, int depth, int h){
+    if(h > 1){
+        int top = h/2, bottom = h - top;
+        VEBL *level = &v->levels[depth+top];
+        level->top_depth = depth;
+        level->top_size = (1 << top) - 1;
+        level->bottom_size = (1 << bottom) - 1;
+        level->mask = (1 << top) - 1;
+        VEB_tables(v,depth,top);
+        VEB_tables(v,depth+top,bottom);
+    }
+}
+
+/* Copies the subtree of height h rooted at position k of the (padded) Eytzinger arrays to the vEB arrays, starting at *next. */
+
+void VEB_fill(VEB *v, int *eyt_keys, int *eyt_ranks, int k, int h, int *next){
+    if(h == 1){
+        v->keys[*next] = eyt_keys[k];
+        v->ranks[*next] = eyt_ranks[k];
+        (*next)++;
+        return;
+    }
+    int top = h/2, bottom = h - top, j;
+    VEB_fill(v,eyt_keys,eyt_ranks,k,top,next);
+    for(j = 0; j < (1 << top); j++) VEB_fill(v,eyt_keys,eyt_ranks,(k << top) + j,bottom,next);
+}
+
+VEB *VEB_from_sorted_array(int *sorted, int n){
+    int h = 0, size, i, next = 0;
+    while((1LL << h) - 1 < n) h++;
+    if(h == 0) h = 1;
+    if(h > VEB_MAX_HEIGHT) return NULL;
+    size = (1 << h) - 1;
+    VEB *v = (VEB*)malloc(sizeof(VEB));
+
+    int *padded = (int*)malloc(size*sizeof(int));
+    for(i = 0; i < size; i++) padded[i] = i < n ? sorted[i] : INT_MAX;
+    EYT *e = EYT_from_sorted_array(padded,size);
+    for(i = 1; i <= size; i++) if(e->ranks[i] > n) e->ranks[i] = n;
+
+    v->n = n;
+    v->height = h;
+    v->keys = aligned_int_array(size);
+    v->ranks = (int*)malloc(size*sizeof(int));
+    VEB_tables(v,0,h);
+    VEB_fill(v,e->keys,e->ranks,1,h,&next);
+    EYT_free(e);
+    free(padded);
+    return v;
+}
+
+VEB *BST_freeze_veb(BST *b){
+    int n = BST_inorder_to_array(b,NULL);
+    int *sorted = (int*)malloc((n+1)*sizeof(int));
+    BST_inorder_to_array(b,sorted);
+    VEB *v = VEB_from_sorted_array(sorted,n);
+    free(sorted);
+    return v;
+}
+
+VEB *VEB_free(VEB *v){
+    if(v){
+        free(v->keys);
+        free(v->ranks);
+        free(v);
+    }
+    return NULL;
+}
+
+/* As for the Eytzinger layout, the descent has no branch: the candidate answer is updated with a conditional move. The functions
+return the position of the answer in v->keys, or -1. The height is at most VEB_MAX_HEIGHT, so pos fits in a small local vector.
+
+REMARK: each step needs the arithmetic above before the next key can be loaded, and the next positions are too far apart to be 
+prefetched, so in practice the Eytzinger search with prefetching is faster (see the benchmark in the main function). The vEB 
+layout pays off when the cost of a miss grows with the distance, as for pages of a memory-mapped file or TLB misses on large 
+arrays, and it does not need to know the block size. */
+
+int VEB_lower_bound(VEB *v, int x){
+    int pos[VEB_MAX_HEIGHT], d, k = 1, best = -1;
+    pos[0] = 0;
+    for(d = 0; d < v->height; d++){
+        VEBL *level = &v->levels[d];
+        if(d > 0) pos[d] = pos[level->top_depth] + level->top_size + (k & level->mask) * level->bottom_size;
+        int go_right = v->keys[pos[d]] < x;
+        best = go_right ? best : pos[d];
+        k = 2*k + go_right;
+    }
+    if(best >= 0 && v->ranks[best] == v->n) return -1;
+    return best;
+}
+
+int VEB_upper_bound(VEB *v, int x){
+    int pos[VEB_MAX_HEIGHT], d, k = 1, best = -1;
+    pos[0] = 0;
+    for(d = 0; d < v->height; d++){
+        VEBL *level = &v->levels[d];
+        if(d > 0) pos[d] = pos[level->top_depth] + level->top_size + (k & level->mask) * level->bottom_size;
+        int go_right = v->keys[pos[d]] <= x;
+        best = go_right ? best : pos[d];
+        k = 2*k + go_right;
+    }
+    if(best >= 0 && v->ranks[best] == v->n) return -1;
+    return best;
+}
+
+int VEB_rank(VEB *v, int x){
+    int p = VEB_lower_bound(v,x);
+    return p >= 0 ? v->ranks[p] : v->n;
+}
+
+int *VEB_search(VEB *v, int x){
+    int p = VEB_lower_bound(v,x);
+    if(p >= 0 && v->keys[p] == x) return &v->keys[p];
+    return NULL;
+}
+
+/* END OF STATIC LAYOUTS -- EYTZINGER AND VAN EMDE BOAS */
+
+/* BULK LOADING AND MERGING */
+
+/* Building a tree with n calls to BST_insert takes O(nlogn) time in the best case and O(n^2) time when the keys come sorted, 
+and each node is a separate malloc. When the keys are already sorted, we can do much better: the middle key is the root and 
+the two halves are, recursively, the subtrees. This is what VET2BST does, but VET2BST copies both halves at each level 
+(O(nlogn) time and memory). Below, the halves are just pointers into the same vector, so the construction is O(n), and all the 
+nodes are taken from a single vector of n nodes, in preorder. Besides saving n-1 calls to malloc, the nodes near the root are 
+next to each other in memory, and each subtree occupies a contiguous piece of the vector.
+
+Since the nodes are not separate blocks, a tree built this way is read-only with respect to BST_remove and BST_free (both 
+call free on single nodes), and BST_insert would mix in nodes that are separate blocks. It is released with BST_free_bulk, 
+and nothing else. The same holds for the trees of BST_from_preorder_array_linear and BST_merge, below. 
+
+REMARK: if the vector has repeated keys, the root is the last copy of the middle key, so that the other copies go to the left
+subtree, as in BST_insert (left <= node < right), and BST_search and BST_remove go the right way. With many repeated keys the
+tree is less balanced, but this cannot be avoided under that rule. */
+
+BST *BST_fill_from_sorted(BST *nodes, int *next, int *vet, int n){
+    if(n <= 0) return NULL;
+    int mid = n/2;
+    while(mid+1 < n && vet[mid+1] == vet[mid]) mid++;
+    BST *node = &nodes[(*next)++];
+    node->key = vet[mid];
+    node->left = BST_fill_from_sorted(nodes,next,vet,mid);
+    node->right = BST_fill_from_sorted(nodes,next,&vet[mid+1],n-mid-1);
+    return node;
+}
+
+BST *BST_bulk_load(int *vet, int n){
+    if(n <= 0) return NULL;
+    BST *nodes = (BST*)malloc(n*sizeof(BST));
+    int next = 0;
+    return BST_fill_from_sorted(nodes,&next,vet,n);
+}
+
+/* The root is the first node of the vector of nodes (they are in preorder), so freeing it releases the whole tree. */
+
+void BST_free_bulk(BST *b){
+    free(b);
+}
+
+/* BST_from_preorder_array looks for the first key greater than the root at each call, which is O(n^2) time in the worst case
+(and it recurses n deep for a sorted vector). There is an O(n) algorithm with a stack of the nodes whose right subtree is still 
+open. We read the keys in order. A key lesser than or equal to the node on top of the stack is its left child. Otherwise, we pop 
+every node whose key is lesser than the new key: the new key is the right child of the last popped node. In both cases the new 
+node is pushed. Each node is pushed and popped at most once.
+
+The last popped key is also a lower bound for all the keys that follow, since they are in right subtrees of that node. If a key
+is not greater than this bound, the vector is not a preorder array, and the function returns NULL. So it also checks, in O(n) 
+time, what is_array_in_preorder checks in O(n^2) time. As above, the nodes are taken from a single vector (node i holds vec[i]),
+and the stack is a vector of n pointers, not an STA. The tree is released with BST_free_bulk. */
+
+BST *BST_from_preorder_array_linear(int *vec, int n){
+    if(n <= 0) return NULL;
+    BST *nodes = (BST*)malloc(n*sizeof(BST));
+    BST **stack = (BST**)malloc(n*sizeof(BST*));
+    int i, top = 0, has_bound = 0, bound = 0;
+    for(i = 0; i < n; i++){
+        nodes[i].key = vec[i];
+        nodes[i].left = nodes[i].right = NULL;
+    }
+    stack[top++] = &nodes[0];
+    for(i = 1; i < n; i++){
+        if(has_bound && vec[i] <= bound){
+            free(stack);
+            free(nodes);
+            return NULL;
+        }
+        if(vec[i] <= stack[top-1]->key) stack[top-1]->left = &nodes[i];
+        else{
+            BST *parent = NULL;
+            while(top > 0 && stack[top-1]->key < vec[i]) parent = stack[--top];
+            parent->right = &nodes[i];
+            bound = parent->key;
+            has_bound = 1;
+        }
+        stack[top++] = &nodes[i];
+    }
+    free(stack);
+    return &nodes[0];
+}
+
+/* To merge two BST's with n and m nodes, inserting the nodes of one in the other costs O(mlog(n+m)) time at best. Instead, we 
+flatten both trees into sorted vectors (with the Morris traversal of BST_inorder_to_array), merge the two vectors as in merge 
+sort and bulk load the result: O(n+m) time. The input trees are not modified, and the output is a new balanced tree (released
+with BST_free_bulk). */
+
+BST *BST_merge(BST *b1, BST *b2){
+    int n = BST_inorder_to_array(b1,NULL), m = BST_inorder_to_array(b2,NULL);
+    int *vet1 = (int*)malloc((n+1)*sizeof(int)), *vet2 = (int*)malloc((m+1)*sizeof(int));
+    int *merged = (int*)malloc((n+m+1)*sizeof(int));
+    int i = 0, j = 0, k = 0;
+    BST_inorder_to_array(b1,vet1);
+    BST_inorder_to_array(b2,vet2);
+    while(i < n && j < m){
+        if(vet1[i] <= vet2[j]) merged[k++] = vet1[i++];
+        else merged[k++] = vet2[j++];
+    }
+    while(i < n) merged[k++] = vet1[i++];
+    while(j < m) merged[k++] = vet2[j++];
+    BST *output = BST_bulk_load(merged,k);
+    free(vet1);
+    free(vet2);
+    free(merged);
+    return output;
+}
+
+/* END OF BULK LOADING AND MERGING */
+
+/* KEY/VALUE MAPS */
+
+/* All the trees above store an int and nothing else. To use a tree as a map (for example, from strings to records), the key and 
+the value must be arbitrary pieces of memory. We pass them as an address and a size, and the order of the keys is given by a 
+comparison function, which receives two keys with their sizes and returns a negative number, zero or a positive number (as 
+strcmp). The tree is balanced as an AVL.
+
+The simplest way to store a key would be a pointer to a copy of it. But then a search would read, at each node, the node and
+the key, which are in different places of the memory: two independent cache misses per level. So a node is allocated with 
+room for its key and its value right after its fields, when they are small (up to KVM_INLINE_SIZE bytes each). Such a node
+(a 40-byte header and up to 64 bytes of data, behind the 16-byte alignment of malloc) often spans two cache lines, but they 
+are adjacent, so the second one usually comes with the first (by the hardware prefetcher) instead of being a second miss. Only larger keys 
+or values are stored in separate blocks, and the node keeps a pointer to them. In both cases, the functions KVN_key and 
+KVN_value give the address of the key and of the value. 
+
+The field data is declared as long long only to make it 8-byte aligned, so that the inline value may hold, for example, a 
+structure with double's. A key occupies a multiple of 8 bytes for the same reason. Keys are distinct: putting a key which is 
+already in the map replaces its value. */
+
+#define KVM_INLINE_SIZE 32
+
+typedef int (*KVM_compare)(const void *key1, size_t size1, const void *key2, size_t size2);
+
+typedef struct kv_node{
+    struct kv_node *left, *right;
+    size_t key_size, value_size;
+    int height;
+    long long data[];
+}KVN; /* KVN stands for Key/Value Node */
+
+typedef struct kv_map{
+    KVN *root;
+    KVM_compare compare;
+    int size;
+}KVM; /* KVM stands for Key/Value Map */
+
+/* Two comparison functions: byte by byte (for strings, without the final '\0', or for any key where the order does not 
+matter), and for int keys. KVM_compare_int only reads ints from keys of sizeof(int) bytes: the other keys are ordered by 
+their size, and then byte by byte. */
+
+int KVM_compare_bytes(const void *key1, size_t size1, const void *key2, size_t size2){
+    int result = memcmp(key1,key2,size1 < size2 ? size1 : size2);
+    if(result) return result;
+    return (size1 > size2) - (size1 < size2);
+}
+
+int KVM_compare_int(const void *key1, size_t size1, const void *key2, size_t size2){
+    if(size1 != size2) return (size1 > size2) - (size1 < size2);
+    if(size1 != sizeof(int)) return memcmp(key1,key2,size1);
+    int x = *(const int*)key1, y = *(const int*)key2;
+    return (x > y) - (x < y);
+}
+
+size_t KVN_key_room(size_t key_size){
+    if(key_size <= KVM_INLINE_SIZE) return (key_size + 7) / 8 * 8;
+    return sizeof(void*);
+}
+
+/* The pointers to keys and values stored outside the node are read and written with memcpy, since the bytes of data are not 
+declared as pointers. */
+
+const void *KVN_key(KVN *node){
+    void *pointer;
+    if(node->key_size <= KVM_INLINE_SIZE) return node->data;
+    memcpy(&pointer,node->data,sizeof(void*));
+    return pointer;
+}
+
+void *KVN_value(KVN *node){
+    unsigned char *place = (unsigned char*)node->data + KVN_key_room(node->key_size);
+    void *pointer;
+    if(node->value_size <= KVM_INLINE_SIZE) return place;
+    memcpy(&pointer,place,sizeof(void*));
+    return pointer;
+}
+
+KVN *KVN_create(const void *key, size_t key_size, const void *value, size_t value_size){
+    size_t key_room = KVN_key_room(key_size);
+    size_t value_room = value_size <= KVM_INLINE_SIZE ? value_size : sizeof(void*);
+    KVN *node = (KVN*)malloc(sizeof(KVN) + key_room + value_room);
+    unsigned char *place = (unsigned char*)node->data;
+    node->left = node->right = NULL;
+    node->key_size = key_size;
+    node->value_size = value_size;
+    node->height = 1;
+    if(key_size <= KVM_INLINE_SIZE) memcpy(place,key,key_size);
+    else{
+        void *copy = malloc(key_size);
+        memcpy(copy,key,key_size);
+        memcpy(place,&copy,sizeof(void*));
+    }
+    place += key_room;
+    if(value_size <= KVM_INLINE_SIZE) memcpy(place,value,value_size);
+    else{
+        void *copy = malloc(value_size);
+        memcpy(copy,value,value_size);
+        memcpy(place,&copy,sizeof(void*));
+    }
+    return node;
+}
+
+void KVN_free_node(KVN *node){
+    if(node->key_size > KVM_INLINE_SIZE) free((void*)KVN_key(node));
+    if(node->value_size > KVM_INLINE_SIZE) free(KVN_value(node));
+    free(node);
+}
+
+void KVN_free(KVN *node){
+    if(node){
+        KVN_free(node->left);
+        KVN_free(node->right);
+        KVN_free_node(node);
+    }
+}
+
+KVM *KVM_initialize(KVM_compare compare){
+    KVM *m = (KVM*)malloc(sizeof(KVM));
+    m->root = NULL;
+    m->compare = compare;
+    m->size = 0;
+    return m;
+}
+
+KVM *KVM_free(KVM *m){
+    if(m){
+        KVN_free(m->root);
+        free(m);
+    }
+    return NULL;
+}
+
+/* Balancing, exactly as for AVL trees. */
+
+int KVN_height(KVN *node){
+    if(node) return node->height;
+    return 0;
+}
+
+void KVN_update(KVN *node){
+    int hl = KVN_height(node->left), hr = KVN_height(node->right);
+    node->height = 1 + (hl > hr ? hl : hr);
+}
+
+KVN *KVN_rotate_right(KVN *y){
+    KVN *x = y->left;
+    y->left = x->right;
+    x->right = y;
+    KVN_update(y);
+    KVN_update(x);
+    return x;
+}
+
+KVN *KVN_rotate_left(KVN *x){
+    KVN *y = x->right;
+    x->right = y->left;
+    y->left = x;
+    KVN_update(x);
+    KVN_update(y);
+    return y;
+}
+
+KVN *KVN_rebalance(KVN *node){
+    KVN_update(node);
+    int balance = KVN_height(node->left) - KVN_height(node->right);
+    if(balance > 1){
+        if(KVN_height(node->left->left) < KVN_height(node->left->right)) node->left = KVN_rotate_left(node->left);
+        return KVN_rotate_right(node);
+    }
+    if(balance < -1){
+        if(KVN_height(node->right->right) < KVN_height(node->right->left)) node->right = KVN_rotate_right(node->right);
+        return KVN_rotate_left(node);
+    }
+    return node;
+}
+
+/* When the key is already in the map, the value is overwritten in place if it has the same size; otherwise the node is
+replaced by a new one (with room for the new value), which takes its children and its height. */
+
+KVN *KVN_put(KVM *m, KVN *node, const void *key, size_t key_size, const void *value, size_t value_size, int *inserted){
+    if(!node){
+        *inserted = 1;
+        return KVN_create(key,key_size,value,value_size);
+    }
+    int result = m->compare(key,key_size,KVN_key(node),node->key_size);
+    if(result < 0) node->left = KVN_put(m,node->left,key,key_size,value,value_size,inserted);
+    else if(result > 0) node->right = KVN_put(m,node->right,key,key_size,value,value_size,inserted);
+    else{
+        *inserted = 0;
+        if(value_size == node->value_size){
+            memcpy(KVN_value(node),value,value_size);
+            return node;
+        }
+        KVN *new_node = KVN_create(key,key_size,value,value_size);
+        new_node->left = node->left;
+        new_node->right = node->right;
+        new_node->height = node->height;
+        KVN_free_node(node);
+        return new_node;
+    }
+    return KVN_rebalance(node);
+}
+
+/* Returns 1 if the key is new and 0 if its value was replaced. */
+
+int KVM_put(KVM *m, const void *key, size_t key_size, const void *value, size_t value_size){
+    int inserted = 0;
+    m->root = KVN_put(m,m->root,key,key_size,value,value_size,&inserted);
+    m->size += inserted;
+    return inserted;
+}
+
+KVN *KVM_search(KVM *m, const void *key, size_t key_size){
+    KVN *node = m->root;
+    while(node){
+        int result = m->compare(key,key_size,KVN_key(node),node->key_size);
+        if(result == 0) return node;
+        node = result < 0 ? node->left : node->right;
+    }
+    return NULL;
+}
+
+/* The address of the value of a key (and its size, if value_size is not NULL), or NULL if the key is not in the map. */
+
+void *KVM_get(KVM *m, const void *key, size_t key_size, size_t *value_size){
+    KVN *node = KVM_search(m,key,key_size);
+    if(!node) return NULL;
+    if(value_size) *value_size = node->value_size;
+    return KVN_value(node);
+}
+
+/* Since the nodes have different sizes, the remotion of a node with two children cannot copy the key and the value of the 
+sucessor into it, as AVL_remove does. Instead, the sucessor node itself is detached from the right subtree and takes the place 
+of the removed node. */
+
+KVN *KVN_detach_minimum(KVN *node, KVN **minimum){
+    if(!node->left){
+        *minimum = node;
+        return node->right;
+    }
+    node->left = KVN_detach_minimum(node->left,minimum);
+    return KVN_rebalance(node);
+}
+
+KVN *KVN_remove(KVM *m, KVN *node, const void *key, size_t key_size, int *removed){
+    if(!node) return NULL;
+    int result = m->compare(key,key_size,KVN_key(node),node->key_size);
+    if(result < 0) node->left = KVN_remove(m,node->left,key,key_size,removed);
+    else if(result > 0) node->right = KVN_remove(m,node->right,key,key_size,removed);
+    else{
+        KVN *replacement;
+        *removed = 1;
+        if(!node->left || !node->right){
+            replacement = node->left ? node->left : node->right;
+            KVN_free_node(node);
+            return replacement;
+        }
+        KVN *right = KVN_detach_minimum(node->right,&replacement);
+        replacement->left = node->left;
+        replacement->right = right;
+        KVN_free_node(node);
+        return KVN_rebalance(replacement);
+    }
+    return KVN_rebalance(node);
+}
+
+int KVM_remove(KVM *m, const void *key, size_t key_size){
+    int removed = 0;
+    m->root = KVN_remove(m,m->root,key,key_size,&removed);
+    m->size -= removed;
+    return removed;
+}
+
+/* Ordered queries: the node with the smallest key, and the nodes with the smallest key >= (lower bound) or > (sucessor) a 
+given key. Walking a map in order is then: for(node = KVM_minimum(m); node; node = KVM_sucessor(m,KVN_key(node),node->key_size)). */
+
+KVN *KVM_minimum(KVM *m){
+    KVN *node = m->root;
+    if(node) while(node->left) node = node->left;
+    return node;
+}
+
+KVN *KVM_bound(KVM *m, const void *key, size_t key_size, int strict){
+    KVN *node = m->root, *output = NULL;
+    while(node){
+        int result = m->compare(KVN_key(node),node->key_size,key,key_size);
+        if(result > 0 || (result == 0 && !strict)){
+            output = node;
+            node = node->left;
+        }
+        else node = node->right;
+    }
+    return output;
+}
+
+KVN *KVM_lower_bound(KVM *m, const void *key, size_t key_size){
+    return KVM_bound(m,key,key_size,0);
+}
+
+KVN *KVM_sucessor(KVM *m, const void *key, size_t key_size){
+    return KVM_bound(m,key,key_size,1);
+}
+
+/* END OF KEY/VALUE MAPS */
+
+/* SEARCH BENCHMARK */
+
+/* We compare the cost of a lookup in the pointer-based trees (a BST built from keys in random order, so that its height is 
+O(logn), and an AVL) with the B+ tree using each of the in-node searches available on this processor, and with the BST frozen
+in the Eytzinger and vEB layouts. The n keys are drawn 
+at random from [0,4n) and the queries from [0,8n), so roughly one query in nine finds its key. We print the time per
+lookup and the number of keys found, which must be the same for every structure. */
+
+double seconds_now(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+int compare_ints(const void *a, const void *b){
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+void print_benchmark_line(const char *name, double seconds, int queries, int found){
+    printf("%-12s %8.1f ns/lookup %10d found\n", name, seconds*1e9/queries, found);
+}
+
+int run_search_benchmark(int n, int queries){
+    int *keys = (int*)malloc(n*sizeof(int)), *query = (int*)malloc(queries*sizeof(int));
+    const char *kernels[3] = {"scalar","sse2","avx2"};
+    int i, j, found;
+    double start;
+    if(!keys || !query) return 1;
+    srand(1);
+    for(i = 0; i < n; i++) keys[i] = rand() % (4*n);
+    for(i = 0; i < queries; i++) query[i] = rand() % (8*n);
+
+    BST *b = BST_initialize();
+    AVL *a = AVL_initialize();
+    for(i = 0; i < n; i++){
+        b = BST_insert(b,keys[i]);
+        a = AVL_insert(a,keys[i]);
+    }
+    qsort(keys,n,sizeof(int),compare_ints);
+    BPT *t = BPT_bulk_load(keys,n);
+    printf("%d keys (%d distinct), %d lookups; B+ tree height %d, AVL height %d\n", n, t->size, queries, t->height, AVL_height(a));
+
+    found = 0;
+    start = seconds_now();
+    for(i = 0; i < queries; i++) found += BST_search(b,query[i]) != NULL;
+    print_benchmark_line("BST",seconds_now()-start,queries,found);
+
+    found = 0;
+    start = seconds_now();
+    for(i = 0; i < queries; i++) found += AVL_search(a,query[i]) != NULL;
+    print_benchmark_line("AVL",seconds_now()-start,queries,found);
+
+    for(j = 0; j < 3; j++){
+        char name[32];
+        if(!BPT_select_node_search(kernels[j])) continue;
+        found = 0;
+        start = seconds_now();
+        for(i = 0; i < queries; i++) found += BPT_search(t,query[i]) != NULL;
+        sprintf(name,"B+ %s",kernels[j]);
+        print_benchmark_line(name,seconds_now()-start,queries,found);
+    }
+    BPT_select_node_search(NULL);
+
+    EYT *e = BST_freeze(b);
+    found = 0;
+    start = seconds_now();
+    for(i = 0; i < queries; i++) found += EYT_search(e,query[i]) != NULL;
+    print_benchmark_line("Eytzinger",seconds_now()-start,queries,found);
+
+    VEB *v = BST_freeze_veb(b);
+    found = 0;
+    start = seconds_now();
+    for(i = 0; i < queries; i++) found += VEB_search(v,query[i]) != NULL;
+    print_benchmark_line("vEB",seconds_now()-start,queries,found);
+
+    EYT_free(e);
+    VEB_free(v);
+    BST_free(b);
+    AVL_free(a);
+    BPT_free(t);
+    free(keys);
+    free(query);
+    return 0;
+}
+
+/* END OF SEARCH BENCHMARK */
+
+/* CONCURRENT MAPS */
+
+/* None of the trees above may be shared by threads if one of them modifies it: a reader may follow a pointer while a rotation 
+is changing it, or read a node which was just freed. Locking the whole tree for every lookup would make the readers wait for 
+each other. Here we write a map from int keys to int values where the readers never wait.
+
+The idea is to never modify a node that a reader may see. A writer copies the nodes on the path from the root to the place of 
+the change (and the few nodes touched by rotations), changes only the copies, and then makes the new root visible with a single 
+atomic store. A reader loads the root once and then sees a complete, consistent version of the tree, no matter what the 
+writers do afterwards. This is "copy-on-write path copying": each change allocates O(logn) nodes. Writers are serialized by a 
+mutex, which is fine when lookups are much more frequent than changes.
+
+The hard part is to free the old nodes: a reader which loaded the old root may still be walking through them. We use 
+"epoch-based reclamation". The map has a global epoch counter. When a reader starts an operation, it copies the global epoch to 
+its own slot (and it writes 0 there when it finishes). When a writer replaces nodes, it publishes the new root, puts the old 
+nodes in a "retired" list tagged with the current epoch e and increments the global epoch. A reader whose slot holds an epoch 
+greater than e read the global epoch after that increment, hence after the new root was published, so it cannot reach the 
+retired nodes. So the nodes retired at epoch e may be freed as soon as every slot is 0 or greater than e. The slot of a reader is
+updated before it loads the root, and all these operations are sequentially consistent atomic operations, so a writer which 
+sees 0 in a slot knows that the reader will load a root where the retired nodes are no longer present.
+
+Each reader thread must register once, to obtain its slot, and pass the slot to the read functions. The writer knows which nodes
+were created by the current change (and may be modified in place) by their version, which is the number of the change that 
+created them. */
+
+#define CMAP_MAX_READERS 128
+#define CMAP_RECLAIM_THRESHOLD 256
+
+typedef struct cmap_node{
+    int key;
+    int value;
+    int height;
+    unsigned long long version; /* 64 bits, so that it never wraps around */
+    struct cmap_node *left, *right;
+}CMN; /* CMN stands for Concurrent Map Node */
+
+typedef struct cmap_reader{
+    unsigned long active; /* epoch when the current read started, or 0 */
+    char padding[64 - sizeof(unsigned long)]; /* one cache line per reader, so that readers do not slow each other down */
+}CMAPR;
+
+typedef struct cmap_retired{
+    CMN *node;
+    unsigned long epoch;
+}CMAPRT;
+
+typedef struct concurrent_map{
+    CMAPR readers[CMAP_MAX_READERS];
+    CMN *root;
+    unsigned long epoch;
+    int num_readers;
+    pthread_mutex_t write_lock;
+    unsigned long long version;
+    int size;
+    CMAPRT *retired;
+    int num_retired, retired_capacity;
+}CMAP;
+
+/* The map is aligned to 64 bytes, so that each reader slot is in its own cache line. */
+
+CMAP *CMAP_initialize(){
+    size_t bytes = (sizeof(CMAP) + 63) / 64 * 64;
+    CMAP *m = (CMAP*)aligned_alloc(64,bytes);
+    memset(m,0,bytes);
+    m->epoch = 1;
+    pthread_mutex_init(&m->write_lock,NULL);
+    return m;
+}
+
+/* Returns the slot of a new reader, or -1 if there are already CMAP_MAX_READERS readers. */
+
+int CMAP_register_reader(CMAP *m){
+    int slot = __atomic_fetch_add(&m->num_readers,1,__ATOMIC_SEQ_CST);
+    return slot < CMAP_MAX_READERS ? slot : -1;
+}
+
+CMN *CMAP_read_begin(CMAP *m, int slot){
+    __atomic_store_n(&m->readers[slot].active,__atomic_load_n(&m->epoch,__ATOMIC_SEQ_CST),__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&m->root,__ATOMIC_SEQ_CST);
+}
+
+void CMAP_read_end(CMAP *m, int slot){
+    __atomic_store_n(&m->readers[slot].active,0,__ATOMIC_RELEASE);
+}
+
+/* READERS. Inside a read, the nodes never change, so they are read as in any other tree. */
+
+int CMAP_get(CMAP *m, int slot, int key, int *value){
+    CMN *node = CMAP_read_begin(m,slot);
+    while(node && node->key != key) node = key < node->key ? node->left : node->right;
+    if(node) *value = node->value;
+    CMAP_read_end(m,slot);
+    return node != NULL;
+}
+
+int CMAP_predecessor(CMAP *m, int slot, int key, int *output){
+    CMN *node = CMAP_read_begin(m,slot), *best = NULL;
+    while(node){
+        if(node->key < key){
+            best = node;
+            node = node->right;
+        }
+        else node = node->left;
+    }
+    if(best) *output = best->key;
+    CMAP_read_end(m,slot);
+    return best != NULL;
+}
+
+int CMAP_sucessor(CMAP *m, int slot, int key, int *output){
+    CMN *node = CMAP_read_begin(m,slot), *best = NULL;
+    while(node){
+        if(node->key > key){
+            best = node;
+            node = node->left;
+        }
+        else node = node->right;
+    }
+    if(best) *output = best->key;
+    CMAP_read_end(m,slot);
+    return best != NULL;
+}
+
+/* Range scan of [low,high), as AVLRI does: the keys and values found (at most capacity of them) are written in keys and values 
+and the function returns how many were written. The whole scan sees a single version of the tree. */
+
+int CMAP_range(CMAP *m, int slot, int low, int high, int *keys, int *values, int capacity){
+    CMN *stack[AVL_MAX_HEIGHT], *node = CMAP_read_begin(m,slot);
+    int top = 0, count = 0;
+    while(node){
+        if(node->key >= low){
+            stack[top++] = node;
+            node = node->left;
+        }
+        else node = node->right;
+    }
+    while(top > 0 && count < capacity){
+        node = stack[--top];
+        if(node->key >= high) break;
+        keys[count] = node->key;
+        values[count] = node->value;
+        count++;
+        for(node = node->right; node; node = node->left) stack[top++] = node;
+    }
+    CMAP_read_end(m,slot);
+    return count;
+}
+
+/* WRITERS. Every function below runs with the write lock held. */
+
+void CMAP_retire(CMAP *m, CMN *node){
+    if(m->num_retired == m->retired_capacity){
+        m->retired_capacity = m->retired_capacity ? 2*m->retired_capacity : 64;
+        m->retired = (CMAPRT*)realloc(m->retired,m->retired_capacity*sizeof(CMAPRT));
+    }
+    m->retired[m->num_retired].node = node;
+    m->retired[m->num_retired].epoch = m->epoch;
+    m->num_retired++;
+}
+
+/* Frees the retired nodes whose epoch is lesser than the epoch of every active reader. */
+
+void CMAP_reclaim(CMAP *m){
+    unsigned long oldest = ULONG_MAX;
+    int i, kept = 0, readers = __atomic_load_n(&m->num_readers,__ATOMIC_SEQ_CST);
+    if(readers > CMAP_MAX_READERS) readers = CMAP_MAX_READERS;
+    for(i = 0; i < readers; i++){
+        unsigned long active = __atomic_load_n(&m->readers[i].active,__ATOMIC_SEQ_CST);
+        if(active && active < oldest) oldest = active;
+    }
+    for(i = 0; i < m->num_retired; i++){
+        if(m->retired[i].epoch < oldest) free(m->retired[i].node);
+        else m->retired[kept++] = m->retired[i];
+    }
+    m->num_retired = kept;
+}
+
+CMN *CMN_create(CMAP *m, int key, int value){
+    CMN *node = (CMN*)malloc(sizeof(CMN));
+    node->key = key;
+    node->value = value;
+    node->height = 1;
+    node->version = m->version;
+    node->left = node->right = NULL;
+    return node;
+}
+
+/* A node which may be modified by the current change: the node itself, if it was created by this change, or a copy of it 
+(and the original is retired). */
+
+CMN *CMN_writable(CMAP *m, CMN *node){
+    if(node->version == m->version) return node;
+    CMN *copy = (CMN*)malloc(sizeof(CMN));
+    *copy = *node;
+    copy->version = m->version;
+    CMAP_retire(m,node);
+    return copy;
+}
+
+int CMN_height(CMN *node){
+    if(node) return node->height;
+    return 0;
+}
+
+void CMN_update(CMN *node){
+    int hl = CMN_height(node->left), hr = CMN_height(node->right);
+    node->height = 1 + (hl > hr ? hl : hr);
+}
+
+/* Rotations and rebalancing as for AVL trees. The node passed is always writable; the child which goes up is made writable 
+here, since after a remotion it may be a node outside the copied path. */
+
+CMN *CMN_rotate_right(CMAP *m, CMN *y){
+    CMN *x = CMN_writable(m,y->left);
+    y->left = x->right;
+    x->right = y;
+    CMN_update(y);
+    CMN_update(x);
+    return x;
+}
+
+CMN *CMN_rotate_left(CMAP *m, CMN *x){
+    CMN *y = CMN_writable(m,x->right);
+    x->right = y->left;
+    y->left = x;
+    CMN_update(x);
+    CMN_update(y);
+    return y;
+}
+
+CMN *CMN_rebalance(CMAP *m, CMN *node){
+    CMN_update(node);
+    int balance = CMN_height(node->left) - CMN_height(node->right);
+    if(balance > 1){
+        if(CMN_height(node->left->left) < CMN_height(node->left->right)) node->left = CMN_rotate_left(m,CMN_writable(m,node->left));
+        return CMN_rotate_right(m,node);
+    }
+    if(balance < -1){
+        if(CMN_height(node->right->right) < CMN_height(node->right->left)) node->right = CMN_rotate_right(m,CMN_writable(m,node->right));
+        return CMN_rotate_left(m,node);
+    }
+    return node;
+}
+
+CMN *CMN_put(CMAP *m, CMN *node, int key, int value, int *inserted){
+    if(!node){
+        *inserted = 1;
+        return CMN_create(m,key,value);
+    }
+    node = CMN_writable(m,node);
+    if(key < node->key) node->left = CMN_put(m,node->left,key,value,inserted);
+    else if(key > node->key) node->right = CMN_put(m,node->right,key,value,inserted);
+    else{
+        node->value = value;
+        return node;
+    }
+    return CMN_rebalance(m,node);
+}
+
+CMN *CMN_detach_minimum(CMAP *m, CMN *node, CMN **minimum){
+    node = CMN_writable(m,node);
+    if(!node->left){
+        *minimum = node;
+        return node->right;
+    }
+    node->left = CMN_detach_minimum(m,node->left,minimum);
+    return CMN_rebalance(m,node);
+}
+
+/* The key must be in the tree. */
+
+CMN *CMN_remove(CMAP *m, CMN *node, int key){
+    if(key != node->key){
+        node = CMN_writable(m,node);
+        if(key < node->key) node->left = CMN_remove(m,node->left,key);
+        else node->right = CMN_remove(m,node->right,key);
+        return CMN_rebalance(m,node);
+    }
+    CMAP_retire(m,node);
+    if(!node->left || !node->right) return node->left ? node->left : node->right;
+    CMN *replacement, *right = CMN_detach_minimum(m,node->right,&replacement);
+    replacement->left = node->left;
+    replacement->right = right;
+    return CMN_rebalance(m,replacement);
+}
+
+/* A change: the new root is published, then the global epoch moves on, and old nodes are freed when there are enough of them. */
+
+void CMAP_publish(CMAP *m, CMN *root){
+    __atomic_store_n(&m->root,root,__ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&m->epoch,1,__ATOMIC_SEQ_CST);
+    if(m->num_retired >= CMAP_RECLAIM_THRESHOLD) CMAP_reclaim(m);
+}
+
+/* Returns 1 if the key is new and 0 if its value was replaced. */
+
+int CMAP_put(CMAP *m, int key, int value){
+    int inserted = 0;
+    pthread_mutex_lock(&m->write_lock);
+    m->version++;
+    CMN *root = CMN_put(m,m->root,key,value,&inserted);
+    m->size += inserted;
+    CMAP_publish(m,root);
+    pthread_mutex_unlock(&m->write_lock);
+    return inserted;
+}
+
+/* Returns 1 if the key was removed and 0 if it was not in the map. */
+
+int CMAP_remove(CMAP *m, int key){
+    pthread_mutex_lock(&m->write_lock);
+    CMN *node = m->root;
+    while(node && node->key != key) node = key < node->key ? node->left : node->right;
+    if(node){
+        m->version++;
+        CMAP_publish(m,CMN_remove(m,m->root,key));
+        m->size--;
+    }
+    pthread_mutex_unlock(&m->write_lock);
+    return node != NULL;
+}
+
+void CMN_free(CMN *node){
+    if(node){
+        CMN_free(node->left);
+        CMN_free(node->right);
+        free(node);
+    }
+}
+
+/* Checks that the current tree is ordered and balanced, with correct heights (returns its height, or -1). Only for a map which
+is not being modified. */
+
+int CMN_check(CMN *node, long long min, long long max){
+    if(!node) return 0;
+    if(node->key <= min || node->key >= max) return -1;
+    int hl = CMN_check(node->left,min,node->key), hr = CMN_check(node->right,node->key,max);
+    if(hl < 0 || hr < 0 || hl-hr > 1 || hr-hl > 1 || node->height != 1 + (hl > hr ? hl : hr)) return -1;
+    return node->height;
+}
+
+/* No thread may be using the map. */
+
+CMAP *CMAP_free(CMAP *m){
+    if(m){
+        int i;
+        for(i = 0; i < m->num_retired; i++) free(m->retired[i].node);
+        free(m->retired);
+        CMN_free(m->root);
+        pthread_mutex_destroy(&m->write_lock);
+        free(m);
+    }
+    return NULL;
+}
+
+/* END OF CONCURRENT MAPS */
+
+/* CONCURRENCY STRESS TEST AND SCALING BENCHMARK */
+
+/* In the stress test, two writers insert and remove random keys: writer w only touches keys k with k % 2 == w, and keeps the 
+set of its keys in a vector, so at the end we can compare the map with what the writers did. The value of key k is always 
+16k + c, where c is a counter of the writer, so a reader can recognize a value which does not belong to its key. The readers run
+lookups, predecessor/sucessor queries and range scans, and check everything they see. If a freed node were read, the values
+would be wrong (or, with AddressSanitizer, the program would stop). */
+
+#define CMAP_STRESS_KEYS 4096
+
+typedef struct cmap_thread{
+    CMAP *m;
+    int id, slot;
+    int *stop;
+    char *present;
+    long long operations, errors;
+    int lookups, keys;
+}CMAPT; /* CMAPT stands for Concurrent Map Thread */
+
+unsigned xorshift32(unsigned *state){
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+void *cmap_stress_writer(void *argument){
+    CMAPT *t = (CMAPT*)argument;
+    unsigned seed = 12345 + t->id, counter = 0;
+    while(!__atomic_load_n(t->stop,__ATOMIC_RELAXED)){
+        int key = 2*(xorshift32(&seed) % (CMAP_STRESS_KEYS/2)) + t->id;
+        if(xorshift32(&seed) % 3){
+            CMAP_put(t->m,key,16*key + (counter++ % 16));
+            t->present[key] = 1;
+        }
+        else{
+            if(CMAP_remove(t->m,key) != t->present[key]) t->errors++;
+            t->present[key] = 0;
+        }
+        t->operations++;
+    }
+    return NULL;
+}
+
+void *cmap_stress_reader(void *argument){
+    CMAPT *t = (CMAPT*)argument;
+    unsigned seed = 777 + t->id;
+    int keys[64], values[64], i, value, other;
+    while(!__atomic_load_n(t->stop,__ATOMIC_RELAXED)){
+        int key = xorshift32(&seed) % CMAP_STRESS_KEYS;
+        if(CMAP_get(t->m,t->slot,key,&value) && value / 16 != key) t->errors++;
+        if(CMAP_predecessor(t->m,t->slot,key,&other) && other >= key) t->errors++;
+        if(CMAP_sucessor(t->m,t->slot,key,&other) && other <= key) t->errors++;
+        int count = CMAP_range(t->m,t->slot,key,key+200,keys,values,64);
+        for(i = 0; i < count; i++){
+            if(keys[i] < key || keys[i] >= key+200 || values[i] / 16 != keys[i] || (i > 0 && keys[i] <= keys[i-1])) t->errors++;
+        }
+        t->operations++;
+    }
+    return NULL;
+}
+
+int run_cmap_stress_test(int num_readers, int seconds){
+    CMAP *m = CMAP_initialize();
+    pthread_t threads[2 + CMAP_MAX_READERS];
+    CMAPT data[2 + CMAP_MAX_READERS];
+    char present[2][CMAP_STRESS_KEYS];
+    int stop = 0, i, key, value, failures = 0;
+    memset(present,0,sizeof(present));
+    for(i = 0; i < 2 + num_readers; i++){
+        memset(&data[i],0,sizeof(CMAPT));
+        data[i].m = m;
+        data[i].id = i;
+        data[i].stop = &stop;
+        if(i < 2) data[i].present = present[i];
+        else data[i].slot = CMAP_register_reader(m);
+        pthread_create(&threads[i],NULL,i < 2 ? cmap_stress_writer : cmap_stress_reader,&data[i]);
+    }
+    sleep(seconds);
+    __atomic_store_n(&stop,1,__ATOMIC_RELAXED);
+    for(i = 0; i < 2 + num_readers; i++){
+        pthread_join(threads[i],NULL);
+        failures += data[i].errors != 0;
+        printf("%s %d: %lld operations, %lld errors\n", i < 2 ? "writer" : "reader", i < 2 ? i : i-2, data[i].operations, data[i].errors);
+    }
+    for(key = 0; key < CMAP_STRESS_KEYS; key++){
+        if(CMAP_get(m,0,key,&value) != present[key % 2][key]) failures++;
+    }
+    if(CMN_check(m->root,LLONG_MIN,LLONG_MAX) < 0) failures++;
+    printf("%d keys in the map, %d nodes waiting to be freed: %s\n", m->size, m->num_retired, failures ? "FAILED" : "OK");
+    CMAP_free(m);
+    return failures ? 1 : 0;
+}
+
+/* In the scaling benchmark the map holds n keys (the even numbers below 2n) and each of t threads, for t = 1, 2, ..., N, 
+runs the same number of lookups of random numbers below 2n. We measure the total number of lookups per second, first with no 
+writer and then while one writer keeps inserting and removing odd keys. If the readers did not scale, the throughput would 
+stay flat as t grows. */
+
+void *cmap_scaling_reader(void *argument){
+    CMAPT *t = (CMAPT*)argument;
+    unsigned seed = 999 + t->id;
+    int i, value;
+    for(i = 0; i < t->lookups; i++) t->operations += CMAP_get(t->m,t->slot,xorshift32(&seed) % (2*t->keys),&value);
+    return NULL;
+}
+
+void *cmap_scaling_writer(void *argument){
+    CMAPT *t = (CMAPT*)argument;
+    unsigned seed = 4242;
+    while(!__atomic_load_n(t->stop,__ATOMIC_RELAXED)){
+        int key = 2*(xorshift32(&seed) % t->keys) + 1;
+        if(xorshift32(&seed) % 2) CMAP_put(t->m,key,key);
+        else CMAP_remove(t->m,key);
+        t->operations++;
+    }
+    return NULL;
+}
+
+int run_cmap_scaling_benchmark(int max_threads, int n, int lookups){
+    CMAP *m = CMAP_initialize();
+    pthread_t threads[CMAP_MAX_READERS], writer_thread;
+    CMAPT data[CMAP_MAX_READERS], writer;
+    int slots[CMAP_MAX_READERS], i, t, with_writer;
+    for(i = 0; i < n; i++) CMAP_put(m,2*i,2*i);
+    for(i = 0; i < max_threads; i++) slots[i] = CMAP_register_reader(m);
+    printf("%d keys, %d lookups per thread\nthreads  lookups/s (no writer)  lookups/s (1 writer)  writes/s\n", n, lookups);
+    for(t = 1; t <= max_threads; t++){
+        double throughput[2], writes = 0;
+        for(with_writer = 0; with_writer < 2; with_writer++){
+            int stop = 0;
+            double start = seconds_now();
+            memset(&writer,0,sizeof(CMAPT));
+            writer.m = m;
+            writer.keys = n;
+            writer.stop = &stop;
+            if(with_writer) pthread_create(&writer_thread,NULL,cmap_scaling_writer,&writer);
+            for(i = 0; i < t; i++){
+                memset(&data[i],0,sizeof(CMAPT));
+                data[i].m = m;
+                data[i].id = i;
+                data[i].slot = slots[i];
+                data[i].lookups = lookups;
+                data[i].keys = n;
+                pthread_create(&threads[i],NULL,cmap_scaling_reader,&data[i]);
+            }
+            for(i = 0; i < t; i++) pthread_join(threads[i],NULL);
+            double elapsed = seconds_now() - start;
+            if(with_writer){
+                __atomic_store_n(&stop,1,__ATOMIC_RELAXED);
+                pthread_join(writer_thread,NULL);
+                writes = writer.operations / elapsed;
+            }
+            throughput[with_writer] = (double)t*lookups / elapsed;
+        }
+        printf("%7d  %21.3e  %20.3e  %8.3e\n", t, throughput[0], throughput[1], writes);
+    }
+    CMAP_free(m);
+    return 0;
+}
+
+/* END OF CONCURRENCY STRESS TEST AND SCALING BENCHMARK */
+
+int main(int argc, char *argv[]){
+
+    BPT_select_node_search(NULL);
+
+    /* Usage: BinarySearchTrees -bench [number of keys] [number of lookups] */
+    if(argc > 1 && strcmp(argv[1],"-bench") == 0){
+        int n = argc > 2 ? atoi(argv[2]) : 1000000, queries = argc > 3 ? atoi(argv[3]) : 2000000;
+        if(n < 1 || n > INT_MAX/8 || queries < 1){
+            printf("Usage: %s -bench [number of keys] [number of lookups]\n", argv[0]);
+            return 1;
+        }
+        return run_search_benchmark(n,queries);
+    }
+
+    /* Usage: BinarySearchTrees -stress [number of readers] [seconds] */
+    if(argc > 1 && strcmp(argv[1],"-stress") == 0){
+        int readers = argc > 2 ? atoi(argv[2]) : 4, seconds = argc > 3 ? atoi(argv[3]) : 2;
+        if(readers < 0 || readers > CMAP_MAX_READERS || seconds < 1){
+            printf("Usage: %s -stress [number of readers (at most %d)] [seconds]\n", argv[0], CMAP_MAX_READERS);
+            return 1;
+        }
+        return run_cmap_stress_test(readers,seconds);
+    }
+
+    /* Usage: BinarySearchTrees -scale [maximum number of threads] [number of keys] [lookups per thread] */
+    if(argc > 1 && strcmp(argv[1],"-scale") == 0){
+        int max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int n = argc > 3 ? atoi(argv[3]) : 1000000, lookups = argc > 4 ? atoi(argv[4]) : 2000000;
+        if(max_threads < 1 || max_threads > CMAP_MAX_READERS || n < 1 || n > INT_MAX/4 || lookups < 1){
+            printf("Usage: %s -scale [maximum number of threads (at most %d)] [number of keys] [lookups per thread]\n", argv[0], CMAP_MAX_READERS);
+            return 1;
+        }
+        return run_cmap_scaling_benchmark(max_threads,n,lookups);
+    }
+
+    /* Inserting sorted keys in a BST yields a path of height n; the AVL keeps height O(logn). */
+    int i, n = 100000, kth = 0, count = 0;
+    AVL *a = AVL_initialize();
+    for(i = 1; i <= n; i++) a = AVL_insert(a,i);
+    printf("AVL with %d sorted insertions: height %d (check: %d)\n", n, AVL_height(a), AVL_check(a,INT_MIN,INT_MAX));
+    AVL_kth_smallest(a,500,&count,&kth);
+    printf("500th smallest: %d, predecessor of 500: %d, sucessor of 500: %d\n", kth, AVL_predecessor(a,500)->key, AVL_sucessor(a,500)->key);
+    printf("rank of 500: %d, keys in [1000,1999]: %d, 90th percentile: %d\n", AVL_rank(a,500), AVL_count_in_range(a,1000,1999), 
+        AVL_kth(a,(9*AVL_size(a)+9)/10)->key);
+    printf("keys in [1000,2000): %d, sum %lld, min %d, max %d; the first ones: ", AVL_range_count(a,1000,2000), AVL_range_sum(a,1000,2000),
+        AVL_range_min(a,1000,2000)->key, AVL_range_max(a,1000,2000)->key);
+    AVLRI range;
+    AVL *node;
+    AVLRI_initialize(&range,a,1000,1005);
+    while((node = AVLRI_next(&range))) printf("%d--", node->key);
+    printf("\n");
+    for(i = 1; i <= n; i += 2) a = AVL_remove(a,i);
+    a = AVL_valid_range(a,100,120);
+    AVL_print_inorder(a);
+    printf("\n");
+    AVL_free(a);
+
+    /* A balanced BST in a single allocation, built from the same sorted keys as the B+ tree below, and merged with itself. */
+    int *sorted = (int*)malloc(n*sizeof(int));
+    for(i = 0; i < n; i++) sorted[i] = 2*i;
+    BST *b1 = BST_bulk_load(sorted,n), *b2 = BST_merge(b1,b1);
+    printf("BST bulk loaded with %d keys: %d nodes after merging it with itself, check: %d\n", n, BST_inorder_to_array(b2,NULL), BST_check(b1) && BST_check(b2));
+    BST *level_buffer[16];
+    BSTI level;
+    BSTI_initialize(&level,b1,BSTI_LEVEL_ORDER,level_buffer,16);
+    printf("first levels: ");
+    for(i = 0; i < 7; i++) printf("%d--", BSTI_next(&level)->key);
+    printf("\n");
+    BST_free_bulk(b1);
+    BST_free_bulk(b2);
+    free(sorted);
+
+    /* A map from names to records, in alphabetical order. The short names and the records are stored inside the nodes. */
+    typedef struct record{
+        int id;
+        double score;
+    }RECORD;
+    const char *names[5] = {"turing", "hopper", "knuth", "lovelace", "dijkstra"};
+    KVM *map = KVM_initialize(KVM_compare_bytes);
+    KVN *entry;
+    for(i = 0; i < 5; i++){
+        RECORD r = {i, 10.0*i};
+        KVM_put(map,names[i],strlen(names[i]),&r,sizeof(RECORD));
+    }
+    KVM_remove(map,"knuth",5);
+    for(entry = KVM_minimum(map); entry; entry = KVM_sucessor(map,KVN_key(entry),entry->key_size)){
+        printf("%.*s: %d--", (int)entry->key_size, (const char*)KVN_key(entry), ((RECORD*)KVN_value(entry))->id);
+    }
+    printf("\n");
+    KVM_free(map);
+
+    /* The same queries on a B+ tree bulk loaded from a sorted vector, followed by insertions. */
+    int *vet = (int*)malloc(n*sizeof(int));
+    for(i = 0; i < n; i++) vet[i] = 2*i;
+    BPT *t = BPT_bulk_load(vet,n);
+    for(i = 1; i < 2000; i += 2) BPT_insert(t,i);
+    printf("B+ tree with %d keys: height %d, 500th smallest: %d, predecessor of 500: %d, sucessor of 500: %d\n", BPT_number_of_keys(t), 
+        t->height, *BPT_kth_smallest(t,500), *BPT_predecessor(t,500), *BPT_sucessor(t,500));
+    t = BPT_valid_range(t,100,120);
+    BPT_print(t);
+    printf("\n");
+    BPT_free(t);
+    free(vet);
+
+    return 0;
+}
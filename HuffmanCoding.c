@@ -1,9 +1,19 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
-
-#define max_input_size 1000
-#define max_output_size 8*max_input_size
+#include<stdint.h>
+#include<pthread.h>
+#include<unistd.h>
+#include<time.h>
+#include<sys/resource.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#endif
+
+#define max_input_size 1000 /* Only for the interactive test in the main function. */
 
 /* HUFFMAN CODING IMPLEMENTATION */
 
@@ -11,7 +21,11 @@
 in reality the code is useless for real data compression. This happens because the code uses characters '0' and '1' instead
 of bits. Hence, the code is bigger that the input string. Any attempt to turn it into "real" code should start by correcting
 this issue (as far as I know, there is no such a thing as "bit array" in C). Also, some algorithms may not be in optimal
-time/space complexity. Improvements are welcome. */
+time/space complexity. Improvements are welcome. 
+
+UPDATE: the '0'/'1' string functions (encode and decode) are kept as a "debug mode", since they make it easy to see
+what is going on. The "packed mode" (encode_packed and decode_packed, below) writes real bits, and it is the one that
+should be used to actually compress data. */
 
 
 
@@ -22,44 +36,126 @@ sums of frequencies
 
 (2) A priority queue (minimum heap) which we use to iteratively construct the coding tree.
 
-(3) A linked list of Node pointers to keep track of the memory address of the nodes containing each character. 
-This list will be constructed at the same time as the coding tree.
+(3) A linked list of node positions to keep track of the nodes containing each character. This list will be 
+constructed at the same time as the coding tree.
 
 Our first task is to build a coding tree from a given sorted frequency map. */
 
+/* ARENA ALLOCATOR */
+
+/* The nodes, the list of addresses, the priority queue and the map are made of many small objects, which are created 
+together and are useless together once the compression is done. Calling malloc for each of them is slow, fragments the 
+heap and makes it very easy to forget some free (the first versions of this code leaked all of them). Hence they are 
+taken from an "arena": a big chunk of memory from which we hand out consecutive pieces (we just "bump" a counter). 
+Nothing is freed individually: the whole arena is reset (to be reused by the next compression) or freed at once. 
+
+When the chunk is full, a new chunk of twice the size is allocated, and the old one is kept in a list until the next 
+reset. After a reset, only the last (largest) chunk is kept, so once the arena has grown to the size of a compression, 
+the next compressions do not call malloc at all. */
+
+#define ARENA_DEFAULT_CAPACITY (1 << 16)
+#define ARENA_ALIGNMENT 16
+
+typedef struct arena{
+    unsigned char *memory;
+    size_t capacity, used;
+    struct arena *previous; /* the chunks that were filled before this one */
+}Arena;
+
+Arena *Arena_create(size_t capacity){
+    Arena *arena = (Arena*)malloc(sizeof(Arena));
+    arena->memory = (unsigned char*)malloc(capacity);
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->previous = NULL;
+    return arena;
+}
+
+void *Arena_alloc(Arena *arena, size_t size){
+    size = (size + ARENA_ALIGNMENT-1) & ~(size_t)(ARENA_ALIGNMENT-1);
+    if(arena->used + size > arena->capacity){
+        Arena *full = (Arena*)malloc(sizeof(Arena));
+        *full = *arena;
+        arena->capacity = 2*arena->capacity > size ? 2*arena->capacity : size;
+        arena->memory = (unsigned char*)malloc(arena->capacity);
+        arena->used = 0;
+        arena->previous = full;
+    }
+    void *output = arena->memory + arena->used;
+    arena->used += size;
+    return output;
+}
+
+void Arena_reset(Arena *arena){
+    while(arena->previous){
+        Arena *full = arena->previous;
+        arena->previous = full->previous;
+        free(full->memory);
+        free(full);
+    }
+    arena->used = 0;
+}
+
+void Arena_free(Arena *arena){
+    Arena_reset(arena);
+    free(arena->memory);
+    free(arena);
+}
+
+/* END OF ARENA ALLOCATOR */
+
+
 /* TREE NODE DATA STRUCTURE*/
 
+/* A coding tree has at most 256 leaves (one for each byte) and 255 internal nodes. Hence all its nodes are kept in one 
+array of TREE_MAX_NODES nodes, and a node refers to its children and parent by their positions in this array, instead of 
+pointers (NO_NODE means that there is no such node). The whole tree is a single object, taken from the arena at once, 
+its positions are smaller than pointers, and walking it only touches this array. */
+
+#define TREE_MAX_NODES (2*256-1)
+#define NO_NODE -1
+
 typedef struct tree_node{
     int freq;
     int is_leaf;
     char character;
-    struct tree_node *left, *right, *parent;
+    int left, right, parent;
 }Node;
 
-
-Node *Node_initialize(){
-    return NULL;
+typedef struct coding_tree{
+    Node nodes[TREE_MAX_NODES];
+    int size; /* number of nodes in use */
+    int root;
+}Tree;
+
+Tree *Tree_create(Arena *arena){
+    Tree *t = (Tree*)Arena_alloc(arena,sizeof(Tree));
+    t->size = 0;
+    t->root = NO_NODE;
+    return t;
 }
 
-Node *create_nonleaf_node(int freq, Node *left, Node *right, Node *parent){
-    Node *new_node = (Node*)malloc(sizeof(Node));
+/* The functions below add a node to the tree and return its position. */
+
+int create_nonleaf_node(Tree *t, int freq, int left, int right, int parent){
+    Node *new_node = &t->nodes[t->size];
     new_node->freq = freq;
     new_node->is_leaf = 0;
     new_node->left = left;
     new_node->right = right;
     new_node->parent = parent;
-    return new_node;
+    return t->size++;
 }
 
-Node *create_leaf_node(char c, int freq, Node *parent){
-    Node *new_node = (Node*)malloc(sizeof(Node));
+int create_leaf_node(Tree *t, char c, int freq, int parent){
+    Node *new_node = &t->nodes[t->size];
     new_node->freq = freq;
     new_node->character = c;
     new_node->is_leaf = 1;
-    new_node->left = NULL;
-    new_node->right = NULL;
+    new_node->left = NO_NODE;
+    new_node->right = NO_NODE;
     new_node->parent = parent;
-    return new_node;
+    return t->size++;
 }
 
 int max(int a, int b){
@@ -67,9 +163,9 @@ int max(int a, int b){
     return b;
 }
 
-int tree_height(Node *t){
-    if(!t) return -1;
-    return 1 + max(tree_height(t->left),tree_height(t->right));
+int tree_height(Tree *t, int i){
+    if(i == NO_NODE) return -1;
+    return 1 + max(tree_height(t,t->nodes[i].left),tree_height(t,t->nodes[i].right));
 }
 
 /* END OF TREE NODE DATA STRUCTURE */
@@ -78,7 +174,8 @@ int tree_height(Node *t){
 /* PRIORITY QUEUE DATA STRUCTURE */
 
 typedef struct priority_queue{
-    Node *queue[129]; /* ASCII has 128 characters */
+    Tree *tree; /* the tree whose nodes are in the queue */
+    int queue[256]; /* positions of the nodes in the tree (a byte has 256 values) */
     int size;
 }PQ; /* PQ stands for Priority Queue */
 
@@ -99,12 +196,16 @@ int right_child(int i){
     return 2*i+2;
 }
 
+int PQ_freq(PQ *q, int i){
+    return q->tree->nodes[q->queue[i]].freq;
+}
+
 void min_heapfy(PQ *q, int i){
     int smallest = i, left = left_child(i), right = right_child(i);
-    if(left < q->size && q->queue[left]->freq < q->queue[smallest]->freq) smallest = left;
-    if(right < q->size && q->queue[right]->freq < q->queue[smallest]->freq) smallest = right;
+    if(left < q->size && PQ_freq(q,left) < PQ_freq(q,smallest)) smallest = left;
+    if(right < q->size && PQ_freq(q,right) < PQ_freq(q,smallest)) smallest = right;
     if(smallest != i){
-        Node *aux = q->queue[i];
+        int aux = q->queue[i];
         q->queue[i] = q->queue[smallest];
         q->queue[smallest] = aux;
         min_heapfy(q,smallest);
@@ -117,18 +218,26 @@ void build_priority_queue(PQ *q){
     for(j=last_parent;j>=0;j--) min_heapfy(q,j);
 }
 
-Node *remove_minimum(PQ *q){
-    Node *output = q->queue[0];
-    q->queue[0] = q->queue[q->size-1];
-    min_heapfy(q,0);
+/* To remove the minimum, we move the last node to the root and let it "sift down" (this is what min_heapfy does).
+To insert a node, we put it in the end and let it "sift up": while it is smaller than its parent, we swap them. 
+Both operations take O(logn) time, since they only walk along one path of the heap. */
+
+int remove_minimum(PQ *q){
+    int output = q->queue[0];
     q->size = q->size-1;
+    q->queue[0] = q->queue[q->size];
+    min_heapfy(q,0);
     return output;
 }
 
-void priority_queue_insert(PQ *q,Node *node){
-    q->queue[q->size] = node;
+void priority_queue_insert(PQ *q,int node){
+    int i = q->size;
     q->size = q->size+1;
-    build_priority_queue(q);
+    while(i > 0 && PQ_freq(q,parent(i)) > q->tree->nodes[node].freq){
+        q->queue[i] = q->queue[parent(i)];
+        i = parent(i);
+    }
+    q->queue[i] = node;
 }
 
 /* END OF PRIORITY QUEUE DATA STRUCTURE */
@@ -137,7 +246,7 @@ void priority_queue_insert(PQ *q,Node *node){
 /* LINKED LIST OF NODES DATA STRUCTURE */
 
 typedef struct list_node{
-    Node *tree_node;
+    int tree_node; /* position of the node in the tree */
     struct list_node *next;
 }LL; /* LL stands for Linked List. */
 
@@ -145,8 +254,8 @@ LL *LL_initialize(){
     return NULL;
 }
 
-LL *LL_insert(LL *l, Node *tree_node){
-    LL *new_ll_node = (LL*)malloc(sizeof(LL));
+LL *LL_insert(Arena *arena, LL *l, int tree_node){
+    LL *new_ll_node = (LL*)Arena_alloc(arena,sizeof(LL));
     new_ll_node->tree_node = tree_node;
     new_ll_node->next = l;
     return new_ll_node;
@@ -158,36 +267,41 @@ LL *LL_insert(LL *l, Node *tree_node){
 /* CONSTRUCTION OF THE CODING TREE (FROM PRIORITY QUEUE) */
 
 /* REMARK: Always declare a LL pointer to be passed as parameter by reference. This pointer
-we hold the linked list of addresses of the character nodes. Do NOT allocate memory for the list of addresses
-before calling the function. The memory is automatically allocated by the insert method.
-Do as below (where q is the priority queue):
+we hold the linked list of the positions of the character nodes. Do NOT allocate memory for the list of addresses
+before calling the function. The memory is automatically allocated (from the arena) by the insert method.
+The internal nodes are added to the tree of q (whose leaves are already there), and the function returns this tree,
+with its root set. Do as below (where q is the priority queue, created in the same arena):
 
+Arena *arena = Arena_create(ARENA_DEFAULT_CAPACITY);
 LL *list_of_addresses = LL_initialize();
-Node *tree = tree_builder(q,&list_of_addresses);
+Tree *tree = tree_builder(arena,q,&list_of_addresses);
+...
+Arena_free(arena);
 
 */
 
-Node *tree_builder(PQ *q, LL **list_of_addresses){
+Tree *tree_builder(Arena *arena, PQ *q, LL **list_of_addresses){
+    Tree *t = q->tree;
     build_priority_queue(q); /* We make sure q is a priority queue. */
     if(q->size==1){
-        *list_of_addresses = LL_insert(*list_of_addresses,q->queue[0]);
-        return q->queue[0];
+        *list_of_addresses = LL_insert(arena,*list_of_addresses,q->queue[0]);
+        t->root = q->queue[0];
+        return t;
     }
     while(q->size > 1){
         
-        Node *left = remove_minimum(q);
-        build_priority_queue(q);
-        Node *right = remove_minimum(q);
-        Node *new_node = create_nonleaf_node(left->freq+right->freq,left,right,NULL);
+        int left = remove_minimum(q);
+        int right = remove_minimum(q);
+        int new_node = create_nonleaf_node(t,t->nodes[left].freq+t->nodes[right].freq,left,right,NO_NODE);
         priority_queue_insert(q,new_node);
-        build_priority_queue(q);
-        left->parent = new_node;
-        right->parent = new_node;
-        if(left->is_leaf) *list_of_addresses = LL_insert(*list_of_addresses,left);
-        if(right->is_leaf) *list_of_addresses = LL_insert(*list_of_addresses,right);
+        t->nodes[left].parent = new_node;
+        t->nodes[right].parent = new_node;
+        if(t->nodes[left].is_leaf) *list_of_addresses = LL_insert(arena,*list_of_addresses,left);
+        if(t->nodes[right].is_leaf) *list_of_addresses = LL_insert(arena,*list_of_addresses,right);
         
     }
-    return remove_minimum(q);
+    t->root = remove_minimum(q);
+    return t;
 }
 
 /* END OF CONSTRUCTION OF THE CODING TREE */
@@ -195,26 +309,26 @@ Node *tree_builder(PQ *q, LL **list_of_addresses){
 
 /* GETTING THE CODE OF A GIVEN CHARACTER */
 
-Node *char_address(char c, LL *list){
+int char_address(char c, Tree *t, LL *list){
     LL *iter = list;
-    while(iter && iter->tree_node->character != c) iter = iter->next;
+    while(iter && t->nodes[iter->tree_node].character != c) iter = iter->next;
     if(iter) return iter->tree_node;
-    return NULL;
+    return NO_NODE;
 }
 
-void get_code(char c, Node *t, LL *list, char *code){
+void get_code(char c, Tree *t, LL *list, char *code){
     int i = 0;
-    Node *address = char_address(c,list);
-    Node *aux = address, *parent;
-    if(aux == t){
+    int address = char_address(c,t,list);
+    int aux = address, parent;
+    if(aux == t->root){
         *code = '0';
         *(code+1) = '\0';
     }
     else{
-        while(aux!=t){
-            parent = aux->parent;
-            if(aux == parent->left) *(code+i) = '0';
-            else if(aux == parent->right) *(code+i) = '1';
+        while(aux!=t->root){
+            parent = t->nodes[aux].parent;
+            if(aux == t->nodes[parent].left) *(code+i) = '0';
+            else if(aux == t->nodes[parent].right) *(code+i) = '1';
             i++;
             aux = parent;
         }
@@ -235,42 +349,95 @@ void get_code(char c, Node *t, LL *list, char *code){
     
 }
 
+/* The function get_code walks from the leaf up to the root, and finding the leaf already takes a walk through the list
+of addresses. To get the codes of all characters at once, it is much better to traverse the tree from the root, keeping 
+the code of the path. The codes are kept as bits in an array indexed by the character itself (seen as an unsigned char), 
+so it has 256 entries, and getting the code of a character takes O(1) time. The array must be initialized with zero 
+lengths before the call (the call is get_bit_codes_from_tree(t,t->root,0,0,codes)). */
+
+typedef struct bit_code{
+    uint64_t bits;
+    int length; /* 0 means that the character does not occur */
+}Code;
+
+void get_bit_codes_from_tree(Tree *t, int i, uint64_t bits, int depth, Code *codes){
+    if(i == NO_NODE) return;
+    Node *node = &t->nodes[i];
+    if(node->is_leaf){
+        if(depth == 0) depth = 1; /* A tree with a single node: the code is '0'. */
+        codes[(unsigned char)node->character].bits = bits;
+        codes[(unsigned char)node->character].length = depth;
+        return;
+    }
+    get_bit_codes_from_tree(t,node->left,bits << 1,depth+1,codes);
+    get_bit_codes_from_tree(t,node->right,(bits << 1) | 1,depth+1,codes);
+}
+
 /* END OF "GETTING THE CODE OF A GIVEN CHARACTER" */
 
 
 /* CONSTRUCTING THE PRIORITY QUEUE FROM AN INPUT STRING */
 
-Node *search_char(PQ *q, char c){
-    int i;
-    for(i=0;i<q->size;i++){
-        if(c == q->queue[i]->character) return q->queue[i];
+/* We first count the frequency of each of the 256 possible bytes (a "histogram"), and then create one leaf node for 
+each byte that occurs. This works for arbitrary data, which may contain any byte, including '\0'.
+
+The histogram is the first step of every compression, so it should be as fast as reading the memory. The obvious loop
+(freq[input[i]]++) is slow when the same byte repeats: each increment has to wait for the previous one to be stored.
+Hence we keep 4 histograms and add byte i to histogram i%4, so that consecutive bytes never touch the same counter. We 
+also read 8 bytes at once. In the end, the 4 histograms are summed. (SIMD does not help much here, since the increments
+go to "random" positions of the histogram.) */
+
+void count_lane_frequencies(const unsigned char *input, size_t size, unsigned int histograms[4][256]){
+    size_t i = 0;
+    memset(histograms,0,4*256*sizeof(unsigned int));
+    for(;i+8<=size;i+=8){
+        uint64_t word;
+        memcpy(&word,input+i,8);
+        histograms[0][word & 0xFF]++;
+        histograms[1][(word >> 8) & 0xFF]++;
+        histograms[2][(word >> 16) & 0xFF]++;
+        histograms[3][(word >> 24) & 0xFF]++;
+        histograms[0][(word >> 32) & 0xFF]++;
+        histograms[1][(word >> 40) & 0xFF]++;
+        histograms[2][(word >> 48) & 0xFF]++;
+        histograms[3][word >> 56]++;
     }
-    return NULL;
+    for(;i<size;i++) histograms[i%4][input[i]]++;
 }
 
-void insert_char_into_PQ(PQ *q, char c){
-    Node *new_node = create_leaf_node(c,1,NULL);
-    q->queue[q->size] = new_node;
-    q->size = q->size+1;
+/* Since i is a multiple of 8 in the loop, the histogram k counts exactly the bytes at the positions i with i%4 == k 
+(the "lane" k). This is useful for the interleaved streams (see INTERLEAVED STREAMS). */
+
+void count_frequencies(const unsigned char *input, size_t size, unsigned int *freq){
+    unsigned int histograms[4][256];
+    int c;
+    count_lane_frequencies(input,size,histograms);
+    for(c=0;c<256;c++) freq[c] = histograms[0][c] + histograms[1][c] + histograms[2][c] + histograms[3][c];
 }
 
-PQ *create_PQ_from_string(char *string){
-    PQ *new_pq = PQ_initialize();
-    new_pq = (PQ*)malloc(sizeof(PQ));
-    Node *aux;
-    int i = 0;
-    while(*(string+i) != '\0'){
-        if(!search_char(new_pq,*(string+i))) insert_char_into_PQ(new_pq,*(string+i));
-        else{
-            aux = search_char(new_pq,*(string+i));
-            aux->freq = aux->freq+1;
+/* The leaves are created in a new tree, which tree_builder completes. */
+
+PQ *create_PQ_from_frequencies(Arena *arena, unsigned int *freq){
+    PQ *new_pq = (PQ*)Arena_alloc(arena,sizeof(PQ));
+    int c;
+    new_pq->tree = Tree_create(arena);
+    new_pq->size = 0;
+    for(c=0;c<256;c++){
+        if(freq[c]){
+            new_pq->queue[new_pq->size] = create_leaf_node(new_pq->tree,c,freq[c],NO_NODE);
+            new_pq->size++;
         }
-        i++;
     }
     build_priority_queue(new_pq);
     return new_pq;
 }
 
+PQ *create_PQ_from_string(Arena *arena, char *string){
+    unsigned int freq[256];
+    count_frequencies((unsigned char*)string,strlen(string),freq);
+    return create_PQ_from_frequencies(arena,freq);
+}
+
 /* END CONSTRUCTING THE PRIORITY QUEUE FROM AN INPUT STRING */
 
 
@@ -287,9 +454,12 @@ typedef struct map_pair{
     char *code;
 }Pair;
 
+/* The map is indexed by the character itself (seen as an unsigned char), so searching a code takes O(1) time. The 
+entries of characters that do not occur are NULL. */
+
 typedef struct map_of_codes{
-    Pair *map[129];
-    int map_size;
+    Pair *map[256];
+    int map_size; /* number of characters in the map */
 }Map;
 
 Pair *Pair_initialize(){
@@ -300,22 +470,30 @@ Map *Map_initialize(){
     return NULL;
 }
 
-Map *build_map_of_codes(LL *list_of_addresses, Node *t){
-    int max_code_size = tree_height(t);
-    /* The height of the tree is the maximum length of a code. Once we have to allocate memory
-    to each code, we use this number to avoid unnecessary memory allocation; */
+/* We get all the bit codes with a single traversal of the tree, and then write each of them as a string. */
+
+Map *build_map_of_codes(Arena *arena, LL *list_of_addresses, Tree *t){
     LL *iter = list_of_addresses;
     Map *output_map = Map_initialize();
-    output_map = (Map*)malloc(sizeof(Map));
+    output_map = (Map*)Arena_alloc(arena,sizeof(Map));
     output_map->map_size = 0;
+    Code codes[256];
+    int i;
+    for(i=0;i<256;i++){
+        output_map->map[i] = NULL;
+        codes[i].length = 0;
+    }
+    get_bit_codes_from_tree(t,t->root,0,0,codes);
     
     while(iter){
         Pair *new_pair = Pair_initialize();
-        new_pair = (Pair*)malloc(sizeof(Pair));
-        new_pair->character = (iter->tree_node)->character;
-        new_pair->code = malloc((max_code_size+2)*sizeof(char));
-        get_code((iter->tree_node)->character,t,list_of_addresses,new_pair->code);
-        output_map->map[output_map->map_size] = new_pair;
+        new_pair = (Pair*)Arena_alloc(arena,sizeof(Pair));
+        new_pair->character = t->nodes[iter->tree_node].character;
+        Code *code = &codes[(unsigned char)new_pair->character];
+        new_pair->code = (char*)Arena_alloc(arena,(code->length+1)*sizeof(char));
+        for(i=0;i<code->length;i++) new_pair->code[i] = (code->bits >> (code->length-1-i)) & 1 ? '1' : '0';
+        new_pair->code[code->length] = '\0';
+        output_map->map[(unsigned char)new_pair->character] = new_pair;
         output_map->map_size++;
         iter = iter->next;
     }
@@ -323,10 +501,7 @@ Map *build_map_of_codes(LL *list_of_addresses, Node *t){
 }
 
 char *search_code(char c,Map *map_of_codes){
-    int i;
-    for(i=0;i<map_of_codes->map_size;i++){
-        if(map_of_codes->map[i]->character == c) return map_of_codes->map[i]->code;
-    }
+    if(map_of_codes->map[(unsigned char)c]) return map_of_codes->map[(unsigned char)c]->code;
     return NULL;
 }
 
@@ -335,30 +510,37 @@ char *search_code(char c,Map *map_of_codes){
 
 /* THE ENCODING FUNCTION */
 
-/* We pass a pointer to a Node address as a parameter so we can keep the enconding tree in memory. 
-We need this tree for decoding. 
+/* We pass a pointer to a Tree address as a parameter so we can keep the enconding tree in memory. 
+We need this tree for decoding. The tree (and everything else but the output) is taken from the arena, so it lives
+until the arena is freed.
 
-To call the function below, we just have to declare a Node pointer and pass its address as a parameter.
+To call the function below, we just have to declare a Tree pointer and pass its address as a parameter.
 Do as below:
 
-Node *tree;
+Arena *arena = Arena_create(ARENA_DEFAULT_CAPACITY);
+Tree *tree;
 char *output_code;
-output_code = encode(input_string,&tree);
+output_code = encode(arena,input_string,&tree);
 
 */
 
-char *encode(char *input_string, Node **tree){
+char *encode(Arena *arena, char *input_string, Tree **tree){
     char *output_code;
     
-    PQ *priority_queue = create_PQ_from_string(input_string);
+    PQ *priority_queue = create_PQ_from_string(arena,input_string);
     LL *list_of_addresses = LL_initialize();
-    *tree = tree_builder(priority_queue,&list_of_addresses);
+    *tree = tree_builder(arena,priority_queue,&list_of_addresses);
     Map *map_of_codes = Map_initialize();
-    map_of_codes = build_map_of_codes(list_of_addresses,*tree);
-    output_code = malloc(max_output_size*sizeof(char));
+    map_of_codes = build_map_of_codes(arena,list_of_addresses,*tree);
+    int max_code_size = max(tree_height(*tree,(*tree)->root),1);
+    output_code = malloc((strlen(input_string)*max_code_size+1)*sizeof(char));
+    *output_code = '\0';
     int i = 0;
+    char *end = output_code;
     while(*(input_string+i)!='\0'){
-        strcat(output_code,search_code(*(input_string+i),map_of_codes));
+        char *code = search_code(*(input_string+i),map_of_codes);
+        strcpy(end,code);
+        end += strlen(code);
         i++;
     }
     return output_code;
@@ -374,31 +556,34 @@ char *encode(char *input_string, Node **tree){
 
 
 
-char *decode(char *encoded_string, Node *tree){
-    Node *iter = tree;
+char *decode(char *encoded_string, Tree *tree){
+    Node *nodes = tree->nodes;
+    int iter = tree->root;
     char c;
     char *output;
-    output = malloc(max_input_size * sizeof(char));
+    output = malloc((strlen(encoded_string)+1) * sizeof(char));
     int i = 0, j = 0;
-    if(iter->left == NULL && iter->right == NULL){
+    if(nodes[iter].left == NO_NODE && nodes[iter].right == NO_NODE){
         while(*(encoded_string+i) != '\0'){
-            *(output+i) = iter->character;
+            *(output+i) = nodes[iter].character;
             i++;
         }
+        *(output+i) = '\0';
         return output;
     }
     while(*(encoded_string+i) != '\0'){
         c = *(encoded_string+i);
-        iter = tree;
-        while(!iter->is_leaf){
-            if(c == '1') iter = iter->right;
-            else iter = iter->left;
+        iter = tree->root;
+        while(!nodes[iter].is_leaf){
+            if(c == '1') iter = nodes[iter].right;
+            else iter = nodes[iter].left;
             i++;
             c = *(encoded_string+i);
         }
-        *(output+j) = iter->character;
+        *(output+j) = nodes[iter].character;
         j++;
     }
+    *(output+j) = '\0';
 
     return output;
 }
@@ -406,102 +591,2836 @@ char *decode(char *encoded_string, Node *tree){
 /* END OF THE DECODING FUNCTION */
 
 
- /* COMPUTING THE COMPRESSION FACTOR */
+/* BIT STREAMS */
+
+/* Now we correct the issue remarked in the beginning of the file. C has no "bit array", but we can simulate one with
+integers and bitwise operations. A bit writer accumulates the codes in a 64-bit word (bit_buffer) and, whenever this
+word holds at least 32 pending bits, it flushes 4 bytes at once to a byte buffer. The bits are written from the most
+significant to the least significant one: the first bit of the stream is the highest bit of the first byte.
+
+The bit reader does the opposite: it keeps a 64-bit window of the stream, aligned to the left (the next bit to be read
+is the highest bit of the window), and refills it byte by byte when it runs low. Reading past the end of the buffer
+gives zero bits. A bit reader may also read from a file (see BR_initialize_file): then the buffer holds a chunk of the
+file, and it is filled again whenever it is exhausted. */
+
+typedef struct bit_writer{
+    unsigned char *buffer;
+    size_t capacity; /* in bytes */
+    size_t byte_pos;
+    uint64_t bit_buffer;
+    int bit_count; /* number of pending bits in bit_buffer */
+}BW; /* BW stands for Bit Writer */
+
+typedef struct bit_reader{
+    const unsigned char *buffer;
+    size_t size; /* in bytes */
+    size_t byte_pos;
+    uint64_t bit_buffer;
+    int bit_count; /* number of valid bits in bit_buffer */
+    FILE *file; /* NULL when reading from memory, or when the file is exhausted */
+    unsigned char *chunk; /* the buffer, when reading from a file */
+}BR; /* BR stands for Bit Reader */
+
+void BW_initialize(BW *w, size_t capacity){
+    if(capacity < 8) capacity = 8;
+    w->buffer = (unsigned char*)malloc(capacity);
+    w->capacity = capacity;
+    w->byte_pos = 0;
+    w->bit_buffer = 0;
+    w->bit_count = 0;
+}
 
- /* The compression factor is the ratio between the respective bit sizes of the original string and of its
- Huffman code. */
+void BW_reserve(BW *w, size_t extra_bytes){
+    if(w->byte_pos + extra_bytes > w->capacity){
+        while(w->byte_pos + extra_bytes > w->capacity) w->capacity *= 2;
+        w->buffer = (unsigned char*)realloc(w->buffer,w->capacity);
+    }
+}
 
-float compression_factor(char *input_string, char *encoded_string){
-    int input_size = 8*strlen(input_string);
-    int code_size = strlen(encoded_string);
-    float result = (float)code_size / (float) input_size;
-    return result;
+/* Appends the "length" lowest bits of "code". The code must not have any bit set above its length. */
+
+void BW_put_bits(BW *w, uint64_t code, int length){
+    if(length > 32){
+        BW_put_bits(w,code >> 32,length-32);
+        code &= 0xFFFFFFFF;
+        length = 32;
+    }
+    w->bit_buffer = (w->bit_buffer << length) | code;
+    w->bit_count += length;
+    if(w->bit_count >= 32){
+        uint32_t word = (uint32_t)(w->bit_buffer >> (w->bit_count-32));
+        BW_reserve(w,4);
+        w->buffer[w->byte_pos] = word >> 24;
+        w->buffer[w->byte_pos+1] = word >> 16;
+        w->buffer[w->byte_pos+2] = word >> 8;
+        w->buffer[w->byte_pos+3] = word;
+        w->byte_pos += 4;
+        w->bit_count -= 32;
+    }
 }
 
- /* END OF COMPUTING THE COMPRESSION FACTOR */
+/* The inner loop of the encoder: for each byte of the input, one load from the array of codes and one shift-or into 
+the bit buffer. All the codes must have at most 32 bits, and the writer must have room for the whole code (we do not 
+check the capacity inside the loop). */
+
+void BW_put_codes(BW *w, const unsigned char *input, size_t size, Code *codes){
+    uint64_t bit_buffer = w->bit_buffer;
+    int bit_count = w->bit_count;
+    unsigned char *output = w->buffer+w->byte_pos;
+    size_t i;
+    for(i=0;i<size;i++){
+        Code code = codes[input[i]];
+        bit_buffer = (bit_buffer << code.length) | code.bits;
+        bit_count += code.length;
+        if(bit_count >= 32){
+            bit_count -= 32;
+            uint32_t word = (uint32_t)(bit_buffer >> bit_count);
+            output[0] = word >> 24;
+            output[1] = word >> 16;
+            output[2] = word >> 8;
+            output[3] = word;
+            output += 4;
+        }
+    }
+    w->bit_buffer = bit_buffer;
+    w->bit_count = bit_count;
+    w->byte_pos = output-w->buffer;
+}
 
+/* Writes the complete bytes of the buffer to a file, so that the buffer can be reused. The pending bits stay in the
+bit buffer. Returns 0 on success or -1 on failure. */
 
-/* PRINTING FUNCTIONS (FOR TESTS)*/
+int BW_drain(BW *w, FILE *output){
+    size_t size = w->byte_pos;
+    w->byte_pos = 0;
+    if(fwrite(w->buffer,1,size,output) != size) return -1;
+    return 0;
+}
+
+/* Number of bits written so far (including the pending ones). */
+
+size_t BW_bit_length(BW *w){
+    return 8*w->byte_pos + w->bit_count;
+}
+
+/* Writes the pending bits, padding the last byte with zeros. */
+
+void BW_flush(BW *w){
+    BW_reserve(w,4);
+    while(w->bit_count >= 8){
+        w->buffer[w->byte_pos++] = w->bit_buffer >> (w->bit_count-8);
+        w->bit_count -= 8;
+    }
+    if(w->bit_count > 0){
+        w->buffer[w->byte_pos++] = w->bit_buffer << (8-w->bit_count);
+        w->bit_count = 0;
+    }
+}
+
+void BR_initialize(BR *r, const unsigned char *buffer, size_t size){
+    r->buffer = buffer;
+    r->size = size;
+    r->byte_pos = 0;
+    r->bit_buffer = 0;
+    r->bit_count = 0;
+    r->file = NULL;
+    r->chunk = NULL;
+}
+
+#define BR_CHUNK_SIZE (1 << 16)
+
+/* The chunk must be freed afterwards with free(r->chunk). */
+
+void BR_initialize_file(BR *r, FILE *file){
+    BR_initialize(r,NULL,0);
+    r->chunk = (unsigned char*)malloc(BR_CHUNK_SIZE);
+    r->buffer = r->chunk;
+    r->file = file;
+}
+
+/* After a refill, the window holds at least 57 bits. 
+
+When there are 8 bytes left in the buffer, we read them at once (as a big-endian number) and put in the window all the
+bits that fit. The bytes that only fit partially are read again by the next refill, so the bits below the window are
+not zero, but they are the bits of the stream that come next, and the next refill puts the same bits in the same 
+positions. This removes the loop (and the data-dependent branches) from the common case. */
+
+/* The compilers turn this expression into a single load (and a byte swap on little-endian processors). */
 
-void print_coding_tree(Node *t){
-    if(t){
-        if(t->is_leaf){
-            printf("(%c)", t->character);
+uint64_t load_big_endian_64(const unsigned char *p){
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+           ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+void BR_refill(BR *r){
+    if(r->byte_pos+8 <= r->size){
+        r->bit_buffer |= load_big_endian_64(r->buffer+r->byte_pos) >> r->bit_count;
+        r->byte_pos += (63-r->bit_count) >> 3;
+        r->bit_count |= 56;
+        return;
+    }
+    while(r->bit_count <= 56){
+        if(r->byte_pos >= r->size && r->file){
+            r->size = fread(r->chunk,1,BR_CHUNK_SIZE,r->file);
+            r->byte_pos = 0;
+            if(r->size == 0) r->file = NULL;
         }
-        else{
-            printf("(%d",t->freq);
-            print_coding_tree(t->left);
-            print_coding_tree(t->right);
-            printf(")");
+        uint64_t byte = r->byte_pos < r->size ? r->buffer[r->byte_pos] : 0;
+        r->byte_pos++;
+        r->bit_buffer |= byte << (56-r->bit_count);
+        r->bit_count += 8;
+    }
+}
+
+/* Returns the next n bits (1 <= n <= 57) without consuming them. */
+
+uint64_t BR_peek_bits(BR *r, int n){
+    if(r->bit_count < n) BR_refill(r);
+    return r->bit_buffer >> (64-n);
+}
+
+void BR_consume_bits(BR *r, int n){
+    r->bit_buffer <<= n;
+    r->bit_count -= n;
+}
+
+int BR_get_bit(BR *r){
+    int bit = (int)BR_peek_bits(r,1);
+    BR_consume_bits(r,1);
+    return bit;
+}
+
+/* Returns 1 if some of the bits consumed so far were not in the buffer (or file), that is, if the stream is truncated. */
+
+int BR_past_end(BR *r){
+    if(r->file || r->byte_pos <= r->size) return 0;
+    return 8*(r->byte_pos-r->size) > (size_t)r->bit_count;
+}
+
+/* END OF BIT STREAMS */
+
+
+/* PACKED MODE */
+
+/* To write the codes as bits, we use the array of bit codes of the tree (see get_bit_codes_from_tree). */
+
+/* The packed encoding function has the same usage as the encode function, but it returns a byte buffer and gives the 
+number of meaningful bits of this buffer in *bit_length (the last byte is padded with zeros). Do as below:
+
+Tree *tree;
+size_t bit_length;
+unsigned char *output_bytes;
+output_bytes = encode_packed(arena,input_string,&tree,&bit_length);
+
+*/
+
+unsigned char *encode_packed(Arena *arena, char *input_string, Tree **tree, size_t *bit_length){
+    PQ *priority_queue = create_PQ_from_string(arena,input_string);
+    LL *list_of_addresses = LL_initialize();
+    *tree = tree_builder(arena,priority_queue,&list_of_addresses);
+    Code codes[256];
+    int c;
+    for(c=0;c<256;c++) codes[c].length = 0;
+    get_bit_codes_from_tree(*tree,(*tree)->root,0,0,codes);
+
+    BW writer;
+    BW_initialize(&writer,strlen(input_string)/2);
+    int i = 0;
+    while(*(input_string+i)!='\0'){
+        Code *code = &codes[(unsigned char)*(input_string+i)];
+        BW_put_bits(&writer,code->bits,code->length);
+        i++;
+    }
+    *bit_length = BW_bit_length(&writer);
+    BW_flush(&writer);
+    return writer.buffer;
+}
+
+/* The simplest way to decode is to walk the tree from the root following the bits of the stream, until we reach a leaf. 
+We stop when bit_length bits have been read. This is slow (one dependent load per bit), so decode_packed (below) uses a
+decoding table instead, and only falls back to this function when the table cannot be built. */
+
+char *decode_packed_bitwise(unsigned char *encoded_bytes, size_t bit_length, Tree *tree){
+    size_t capacity = 64, j = 0, bits_read = 0;
+    char *output = malloc(capacity * sizeof(char));
+    BR reader;
+    BR_initialize(&reader,encoded_bytes,(bit_length+7)/8);
+    Node *nodes = tree->nodes;
+    while(bits_read < bit_length){
+        int iter = tree->root;
+        if(nodes[iter].is_leaf){
+            BR_consume_bits(&reader,1);
+            bits_read++;
+        }
+        while(!nodes[iter].is_leaf){
+            if(BR_get_bit(&reader)) iter = nodes[iter].right;
+            else iter = nodes[iter].left;
+            bits_read++;
         }
+        if(j+1 >= capacity){
+            capacity *= 2;
+            output = realloc(output,capacity * sizeof(char));
+        }
+        *(output+j) = nodes[iter].character;
+        j++;
     }
+    *(output+j) = '\0';
+    return output;
 }
 
-void print_priority_queue(PQ *q){
+/* END OF PACKED MODE */
+
+
+/* TABLE-DRIVEN DECODING */
+
+/* Instead of reading one bit at a time, we read DECODE_TABLE_BITS bits at once and use them as an index in a table.
+Each entry of the table tells which symbols are at the beginning of these bits and how many bits they use. If the codes 
+are short, the same lookup gives up to DECODE_MAX_SYMBOLS symbols. If the index is the prefix of a code longer than 
+DECODE_TABLE_BITS, the entry points to a second-level table (a "subtable"), which is indexed by the next sub_bits bits.
+
+For example, with codes a = 0, b = 10 and c = 11, and a table of 3 bits, the entry of index 010 gives the symbols a, b 
+and uses all 3 bits, while the entry of index 110 gives c, a and uses 3 bits.
+
+To build the table, we only need the bit code of each symbol. We get them from the tree with a depth-first traversal. */
+
+#define DECODE_TABLE_BITS 10
+#define DECODE_MAX_SYMBOLS 3
+#define DECODE_MAX_SUBTABLE_BITS 12
+
+typedef struct decode_entry{
+    unsigned char symbols[DECODE_MAX_SYMBOLS];
+    unsigned char num_symbols; /* 0 means that the entry points to a subtable */
+    unsigned char length; /* bits used by all the symbols of the entry */
+    unsigned char first_length; /* bits used by the first symbol only */
+    unsigned char sub_bits; /* subtable entries: number of bits indexing the subtable */
+    int sub_offset; /* subtable entries: position of the subtable in the array of entries */
+}DEntry;
+
+typedef struct decode_table{
+    DEntry *entries; /* the first 2^DECODE_TABLE_BITS entries are the main table, then come the subtables */
+    int num_entries;
+    int min_length; /* length of the shortest code */
+}DT; /* DT stands for Decoding Table */
+
+void fill_entries(DEntry *entries, int first, int count, unsigned char symbol, int length){
     int i;
-    for(i=0;i<q->size;i++){
-        printf("%c,%d--",q->queue[i]->character,q->queue[i]->freq);
+    for(i=first;i<first+count;i++){
+        entries[i].symbols[0] = symbol;
+        entries[i].num_symbols = 1;
+        entries[i].length = length;
+        entries[i].first_length = length;
     }
 }
 
-void print_linked_list(LL *l){
-    if(l){
-        printf("%c,%p--",(l->tree_node)->character,l->tree_node);
-        print_linked_list(l->next);
+/* Returns NULL if some code is longer than DECODE_TABLE_BITS + DECODE_MAX_SUBTABLE_BITS. The entries that do not 
+correspond to any code (this only happens if the code is incomplete) have length 0. Such a main entry also looks like 
+a subtable entry (num_symbols is 0), so it points to a subtable of size 1 made of itself: the subtable lookup then 
+gives back the same invalid entry. */
+
+DT *build_decode_table(Code *codes){
+    int main_size = 1 << DECODE_TABLE_BITS, mask = main_size-1;
+    int prefix_max[1 << DECODE_TABLE_BITS];
+    int i, s, total = main_size, min_length = 0;
+    for(i=0;i<main_size;i++) prefix_max[i] = 0;
+
+    /* First, we find the longest code below each prefix, to know the size of the subtables. */
+    for(s=0;s<256;s++){
+        int length = codes[s].length;
+        if(length > DECODE_TABLE_BITS + DECODE_MAX_SUBTABLE_BITS) return NULL;
+        if(length && (!min_length || length < min_length)) min_length = length;
+        if(length > DECODE_TABLE_BITS){
+            int prefix = (int)(codes[s].bits >> (length-DECODE_TABLE_BITS));
+            if(length > prefix_max[prefix]) prefix_max[prefix] = length;
+        }
+    }
+    for(i=0;i<main_size;i++){
+        if(prefix_max[i]) total += 1 << (prefix_max[i]-DECODE_TABLE_BITS);
+    }
+
+    DT *table = (DT*)malloc(sizeof(DT));
+    table->entries = (DEntry*)calloc(total,sizeof(DEntry));
+    table->num_entries = total;
+    table->min_length = min_length;
+    DEntry *entries = table->entries;
+
+    total = main_size;
+    for(i=0;i<main_size;i++){
+        if(prefix_max[i]){
+            entries[i].num_symbols = 0;
+            entries[i].length = DECODE_TABLE_BITS;
+            entries[i].sub_bits = prefix_max[i]-DECODE_TABLE_BITS;
+            entries[i].sub_offset = total;
+            total += 1 << entries[i].sub_bits;
+        }
+        else entries[i].sub_offset = i;
+    }
+
+    /* Now each code fills all the entries whose index starts with it. */
+    for(s=0;s<256;s++){
+        int length = codes[s].length;
+        if(!length) continue;
+        if(length <= DECODE_TABLE_BITS){
+            int shift = DECODE_TABLE_BITS-length;
+            fill_entries(entries,(int)(codes[s].bits << shift),1 << shift,s,length);
+        }
+        else{
+            DEntry *main_entry = &entries[codes[s].bits >> (length-DECODE_TABLE_BITS)];
+            int rest_length = length-DECODE_TABLE_BITS;
+            int rest = (int)(codes[s].bits & ((1 << rest_length)-1));
+            int shift = main_entry->sub_bits-rest_length;
+            fill_entries(entries,main_entry->sub_offset + (rest << shift),1 << shift,s,length);
+        }
+    }
+
+    /* Finally, we append more symbols to the main entries while their codes fit in the remaining bits. The bits after 
+    the first symbol of index i are (i << used) & mask, completed with zeros, so the second symbol is the first symbol
+    of that entry, provided its code is not longer than the number of remaining bits. */
+    for(i=0;i<main_size;i++){
+        DEntry *entry = &entries[i];
+        if(entry->num_symbols != 1) continue;
+        while(entry->num_symbols < DECODE_MAX_SYMBOLS){
+            int used = entry->length;
+            DEntry *next = &entries[(i << used) & mask];
+            if(next->num_symbols == 0 || next->first_length > DECODE_TABLE_BITS-used) break;
+            entry->symbols[entry->num_symbols] = next->symbols[0];
+            entry->num_symbols++;
+            entry->length += next->first_length;
+        }
     }
+    return table;
 }
 
-void print_map(Map *map){
+void DT_free(DT *table){
+    if(table){
+        free(table->entries);
+        free(table);
+    }
+}
+
+/* Decodes the packed code into the output, stopping when bit_length bits have been read or when max_symbols symbols have
+been written. Returns the number of symbols written, or -1 if the code is not valid for the table (or if there are bits
+left when the output is full). */
+
+long decode_symbols(const unsigned char *encoded_bytes, size_t bit_length, DT *table, unsigned char *output, size_t max_symbols){
+    size_t j = 0, bits_read = 0;
+    BR reader;
+    BR_initialize(&reader,encoded_bytes,(bit_length+7)/8);
+    while(bits_read < bit_length && j < max_symbols){
+        DEntry *entry = &table->entries[BR_peek_bits(&reader,DECODE_TABLE_BITS)];
+        if(entry->num_symbols == 0){
+            uint64_t index = BR_peek_bits(&reader,DECODE_TABLE_BITS+entry->sub_bits) & ((1 << entry->sub_bits)-1);
+            entry = &table->entries[entry->sub_offset + index];
+        }
+        if(entry->length == 0) return -1;
+        if(entry->length <= bit_length-bits_read && j+DECODE_MAX_SYMBOLS <= max_symbols){
+            /* We always copy DECODE_MAX_SYMBOLS symbols, but only the first num_symbols ones are kept. */
+            memcpy(output+j,entry->symbols,DECODE_MAX_SYMBOLS);
+            j += entry->num_symbols;
+            BR_consume_bits(&reader,entry->length);
+            bits_read += entry->length;
+        }
+        else{
+            /* Near the end of the stream, the entry may contain symbols decoded from the padding bits. */
+            if(entry->first_length > bit_length-bits_read) return -1;
+            output[j++] = entry->symbols[0];
+            BR_consume_bits(&reader,entry->first_length);
+            bits_read += entry->first_length;
+        }
+    }
+    if(bits_read < bit_length) return -1;
+    return j;
+}
+
+char *decode_with_table(unsigned char *encoded_bytes, size_t bit_length, DT *table){
+    size_t capacity = bit_length/table->min_length;
+    char *output = malloc((capacity+1) * sizeof(char));
+    long size = decode_symbols(encoded_bytes,bit_length,table,(unsigned char*)output,capacity);
+    if(size < 0){
+        free(output);
+        return NULL;
+    }
+    output[size] = '\0';
+    return output;
+}
+
+/* This is the decoding function of the packed mode. It has the same usage as the decode function. */
+
+char *decode_packed(unsigned char *encoded_bytes, size_t bit_length, Tree *tree){
+    Code codes[256];
     int i;
-    for(i=0;i<map->map_size;i++){
-        printf("%c,%s--", map->map[i]->character, map->map[i]->code);
+    for(i=0;i<256;i++) codes[i].length = 0;
+    get_bit_codes_from_tree(tree,tree->root,0,0,codes);
+    DT *table = build_decode_table(codes);
+    if(!table) return decode_packed_bitwise(encoded_bytes,bit_length,tree);
+    char *output = decode_with_table(encoded_bytes,bit_length,table);
+    DT_free(table);
+    return output;
+}
+
+/* END OF TABLE-DRIVEN DECODING */
+
+
+/* CANONICAL CODES */
+
+/* The packed mode still needs the coding tree to decode, and shipping the whole tree with the data is wasteful.
+However, the only thing that really matters in a Huffman code is the length of the code of each symbol: any prefix code with 
+the same lengths compresses exactly as well. The "canonical" code is the one obtained from the lengths by the following rule:
+sort the symbols by (code length, symbol) and give them consecutive codes, shifting left whenever the length increases. 
+For example, the lengths a = 2, b = 1, c = 3, d = 3 give the codes b = 0, a = 10, c = 110 and d = 111.
+
+Hence, the encoder only has to send the code lengths, and the decoder rebuilds the very same codes (and the decoding table)
+from them in O(alphabet) time, without any tree.
+
+The header stores the lengths in a compact way (like the DHT segment of JPEG files):
+
+byte 0:                    number of symbols - 1
+byte 1:                    maximum code length (L)
+bytes 2 to L:              number of symbols with code length 1, 2, ..., L-1 (the number with length L is deduced)
+next (number of symbols):  the symbols sorted by (code length, symbol)
+
+A compressed block is the header, followed by the number of bits of the code (as a "varint": 7 bits per byte, the highest
+bit set meaning that more bytes follow), followed by the packed code itself. */
+
+#define MAX_CODE_LENGTH 63
+
+void assign_canonical_codes(unsigned char *lengths, Code *codes){
+    int count[MAX_CODE_LENGTH+1];
+    uint64_t next_code[MAX_CODE_LENGTH+1], code = 0;
+    int i, s;
+    for(i=0;i<=MAX_CODE_LENGTH;i++) count[i] = 0;
+    for(s=0;s<256;s++) count[lengths[s]]++;
+    count[0] = 0;
+    for(i=1;i<=MAX_CODE_LENGTH;i++){
+        code = (code + count[i-1]) << 1;
+        next_code[i] = code;
+    }
+    for(s=0;s<256;s++){
+        codes[s].length = lengths[s];
+        codes[s].bits = lengths[s] ? next_code[lengths[s]]++ : 0;
     }
 }
-/* END OF PRINTING FUNCTIONS */
 
+/* Returns the number of bytes written. The output must have room for 2 + MAX_CODE_LENGTH + 256 bytes. */
+
+int write_code_lengths_header(unsigned char *lengths, unsigned char *output){
+    int count[MAX_CODE_LENGTH+1];
+    int i, s, num_symbols = 0, max_length = 0, pos = 2;
+    for(i=0;i<=MAX_CODE_LENGTH;i++) count[i] = 0;
+    for(s=0;s<256;s++){
+        if(lengths[s]){
+            count[lengths[s]]++;
+            num_symbols++;
+            if(lengths[s] > max_length) max_length = lengths[s];
+        }
+    }
+    output[0] = num_symbols-1;
+    output[1] = max_length;
+    for(i=1;i<max_length;i++) output[pos++] = count[i];
+    for(i=1;i<=max_length;i++){
+        for(s=0;s<256;s++) if(lengths[s] == i) output[pos++] = s;
+    }
+    return pos;
+}
 
-int main(){
+/* Returns the number of bytes read, or -1 if the header is not valid. A valid header describes a prefix code. */
+
+int read_code_lengths_header(const unsigned char *input, size_t size, unsigned char *lengths){
+    int count[MAX_CODE_LENGTH+1];
+    int i, k, s, num_symbols, max_length, pos = 2, sum = 0;
+    uint64_t kraft = 0;
+    if(size < 2) return -1;
+    num_symbols = input[0]+1;
+    max_length = input[1];
+    if(max_length < 1 || max_length > MAX_CODE_LENGTH || size < (size_t)(max_length+1+num_symbols)) return -1;
+    for(i=1;i<max_length;i++){
+        count[i] = input[pos++];
+        sum += count[i];
+    }
+    count[max_length] = num_symbols-sum;
+    if(count[max_length] < 1) return -1;
+    for(i=1;i<=max_length;i++) kraft += (uint64_t)count[i] << (MAX_CODE_LENGTH-i);
+    if(kraft > (uint64_t)1 << MAX_CODE_LENGTH) return -1;
+    for(s=0;s<256;s++) lengths[s] = 0;
+    for(i=1;i<=max_length;i++){
+        for(k=0;k<count[i];k++){
+            s = input[pos++];
+            if(lengths[s]) return -1;
+            lengths[s] = i;
+        }
+    }
+    return pos;
+}
 
-    /* The main test is below. The user insert a string in the command line. The program constructs all
-    data structures and returns the Huffman code of the string. After, the code is decoded back and the
-    string is printed again (if everything goes right). */
+int write_varint(uint64_t value, unsigned char *output){
+    int pos = 0;
+    while(value >= 0x80){
+        output[pos++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    output[pos++] = value;
+    return pos;
+}
 
-    char input_string[max_input_size];
-    scanf("%s",input_string);
-    char *output_code;
-    Node *tree;
-    output_code = encode(input_string,&tree);
-    printf("%s",output_code);
-    printf("\n");
-    char *get_string_back;
-    get_string_back = decode(output_code,tree);
-    printf("%s\n",get_string_back);
-    printf("%f\n",compression_factor(input_string,output_code));
+/* Returns the number of bytes read, or -1 if the input ends before the varint. */
+
+int read_varint(const unsigned char *input, size_t size, uint64_t *value){
+    int pos = 0, shift = 0;
+    *value = 0;
+    while((size_t)pos < size && shift < 64){
+        *value |= (uint64_t)(input[pos] & 0x7F) << shift;
+        if(!(input[pos++] & 0x80)) return pos;
+        shift += 7;
+    }
+    return -1;
+}
+
+/* The code lengths are obtained from the frequencies by building the coding tree. Here we do not need a whole Tree (the 
+characters and the children are useless): the nodes are kept in a local array and identified by their position. The leaves are the positions 0 to n-1 (sorted by frequency), and the internal nodes are the positions n to 
+2n-2, in the order in which they are created. Since the leaves are sorted, we do not need a priority queue at all: the 
+internal nodes are created in non-decreasing order of frequency, so they form a second (FIFO) queue, which is 
+automatically sorted, and at each step the two smallest nodes are at the front of the two queues. This gives an O(n) 
+construction (the classical "two-queue" method). Each node only keeps its frequency and the position of its parent. 
+Since a parent is always created after its children, the depth of all nodes is computed with a single backward pass, 
+from the root (the last node) down to the leaves. There is no allocation at all, and the whole tree (8 KB) stays in 
+the cache.
+
+On very skewed inputs, the tree may be very deep, and long codes are bad for us: the decoding table does not accept 
+codes longer than BLOCK_MAX_CODE_LENGTH, and its subtables grow exponentially with the length of the codes. Hence the 
+blocks use codes of at most max_code_length bits (DEFAULT_MAX_CODE_LENGTH, unless the user chooses otherwise). With 15
+bits, the whole decoding table is small enough to stay in the L1 cache. When the tree is too deep, we compute the 
+optimal lengths under this limit with the "package-merge" algorithm (below). */
+
+#define BLOCK_MAX_CODE_LENGTH (DECODE_TABLE_BITS + DECODE_MAX_SUBTABLE_BITS)
+#define DEFAULT_MAX_CODE_LENGTH 15
+#define MIN_CODE_LENGTH_LIMIT 8 /* 256 symbols need codes of 8 bits */
+
+typedef struct flat_node{
+    uint64_t freq;
+    int parent;
+}FNode;
+
+/* To sort the symbols by (frequency, symbol), we sort the keys frequency*256 + symbol. */
+
+int compare_keys(const void *a, const void *b){
+    uint64_t x = *(uint64_t*)a, y = *(uint64_t*)b;
+    if(x != y) return x < y ? -1 : 1;
+    return 0;
+}
+
+/* Gives the bytes that occur, sorted by frequency, and their frequencies. Returns how many they are. */
+
+int sorted_symbols_from_frequencies(unsigned int *freq, unsigned char *symbols, unsigned int *sorted_freq){
+    uint64_t keys[256];
+    int c, n = 0;
+    for(c=0;c<256;c++){
+        if(freq[c]) keys[n++] = ((uint64_t)freq[c] << 8) | c;
+    }
+    qsort(keys,n,sizeof(uint64_t),compare_keys);
+    for(c=0;c<n;c++){
+        symbols[c] = keys[c] & 0xFF;
+        sorted_freq[c] = keys[c] >> 8;
+    }
+    return n;
+}
+
+/* The frequencies must be sorted in increasing order (and n >= 1). */
+
+void flat_code_lengths(unsigned int *sorted_freq, int n, unsigned char *sorted_lengths){
+    FNode nodes[2*256-1];
+    unsigned char depth[2*256-1];
+    int leaf_front = 0, internal_front = n, next = n, i, k;
+    if(n == 1){
+        sorted_lengths[0] = 1;
+        return;
+    }
+    for(i=0;i<n;i++) nodes[i].freq = sorted_freq[i];
+    while(next < 2*n-1){
+        int smallest[2];
+        for(k=0;k<2;k++){
+            if(internal_front == next || (leaf_front < n && nodes[leaf_front].freq <= nodes[internal_front].freq)){
+                smallest[k] = leaf_front++;
+            }
+            else smallest[k] = internal_front++;
+        }
+        nodes[next].freq = nodes[smallest[0]].freq + nodes[smallest[1]].freq;
+        nodes[smallest[0]].parent = next;
+        nodes[smallest[1]].parent = next;
+        next++;
+    }
+    depth[2*n-2] = 0;
+    for(i=2*n-3;i>=0;i--) depth[i] = depth[nodes[i].parent]+1;
+    for(i=0;i<n;i++) sorted_lengths[i] = depth[i];
+}
+
+/* PACKAGE-MERGE. Think of each symbol as a coin of "width" 2^-L (L = max_length) and value equal to its frequency, 
+available at each of the L levels. Choosing a code of length l for a symbol means choosing its coins at the l deepest 
+levels... it is easier to describe the algorithm itself:
+
+(1) At the deepest level L, the list of items is the list of symbols, sorted by frequency.
+(2) At each level above, the list of items is the merge (sorted by frequency) of the symbols and of the "packages" 
+obtained by pairing the items of the level below: the first two items make a package, the next two make another package
+and so on (an unpaired last item is discarded). The frequency of a package is the sum of the frequencies of its items.
+(3) At the top level, we select the first 2n-2 items (n is the number of symbols). Each selected symbol gets one more
+bit in its code, and each selected package selects its two items at the level below, recursively.
+
+Since the lists are sorted and the selection is always a prefix of a list, we do not need to remember which items are
+inside each package: if k items are selected at some level, and p of them are packages, then the first 2p items are 
+selected at the level below, and the selected symbols are the k-p symbols of smallest frequency. Hence, for each level, 
+we only keep whether each item is a symbol or a package. 
+
+The frequencies must be sorted in increasing order, and n must be at most 2^max_length. */
+
+void package_merge(unsigned int *sorted_freq, int n, int max_length, unsigned char *sorted_lengths){
+    unsigned char is_package[BLOCK_MAX_CODE_LENGTH][2*256];
+    int num_items[BLOCK_MAX_CODE_LENGTH];
+    uint64_t items[2*256], packages[256];
+    int level, i, j, k, num_packages = 0;
+    for(i=0;i<n;i++) sorted_lengths[i] = 0;
+    if(n == 1){
+        sorted_lengths[0] = 1;
+        return;
+    }
+    /* level 0 is the top level (codes of 1 bit), and level max_length-1 is the deepest one. */
+    for(level=max_length-1;level>=0;level--){
+        i = 0;
+        j = 0;
+        k = 0;
+        while(i < n || j < num_packages){
+            if(j == num_packages || (i < n && sorted_freq[i] <= packages[j])){
+                items[k] = sorted_freq[i++];
+                is_package[level][k++] = 0;
+            }
+            else{
+                items[k] = packages[j++];
+                is_package[level][k++] = 1;
+            }
+        }
+        num_items[level] = k;
+        num_packages = k/2;
+        for(i=0;i<num_packages;i++) packages[i] = items[2*i] + items[2*i+1];
+    }
+    int selected = 2*n-2;
+    for(level=0;level<max_length && selected > 0;level++){
+        int selected_packages = 0;
+        if(selected > num_items[level]) selected = num_items[level];
+        for(i=0;i<selected;i++) selected_packages += is_package[level][i];
+        for(i=0;i<selected-selected_packages;i++) sorted_lengths[i]++;
+        selected = 2*selected_packages;
+    }
+}
+
+void build_code_lengths(unsigned int *freq, int max_length, unsigned char *lengths){
+    unsigned char symbols[256], sorted_lengths[256];
+    unsigned int sorted_freq[256];
+    int i, n, longest = 0;
+    for(i=0;i<256;i++) lengths[i] = 0;
+    n = sorted_symbols_from_frequencies(freq,symbols,sorted_freq);
+    if(n == 0) return;
+    flat_code_lengths(sorted_freq,n,sorted_lengths);
+    for(i=0;i<n;i++) if(sorted_lengths[i] > longest) longest = sorted_lengths[i];
+    if(longest > max_length) package_merge(sorted_freq,n,max_length,sorted_lengths);
+    for(i=0;i<n;i++) lengths[symbols[i]] = sorted_lengths[i];
+}
+
+void BW_reset(BW *w){
+    w->byte_pos = 0;
+    w->bit_buffer = 0;
+    w->bit_count = 0;
+}
+
+/* Writes the block of a (non-empty) input buffer in the writer, which is reset first, and returns the size of the block
+in bytes. The codes have at most max_code_length bits (from MIN_CODE_LENGTH_LIMIT to BLOCK_MAX_CODE_LENGTH). Since we 
+know the frequencies and the code lengths, we know the number of bits of the code before encoding. */
+
+size_t encode_block(const unsigned char *input, size_t size, int max_code_length, BW *writer){
+    unsigned int freq[256];
+    unsigned char lengths[256];
+    Code codes[256];
+    uint64_t bit_length = 0;
+    size_t i;
+    count_frequencies(input,size,freq);
+    build_code_lengths(freq,max_code_length,lengths);
+    assign_canonical_codes(lengths,codes);
+    for(i=0;i<256;i++) bit_length += (uint64_t)freq[i]*lengths[i];
+
+    BW_reset(writer);
+    BW_reserve(writer,2+MAX_CODE_LENGTH+256+10+(bit_length+7)/8);
+    writer->byte_pos = write_code_lengths_header(lengths,writer->buffer);
+    writer->byte_pos += write_varint(bit_length,writer->buffer+writer->byte_pos);
+    BW_put_codes(writer,input,size,codes);
+    BW_flush(writer);
+    return writer->byte_pos;
+}
+
+/* Reads the code lengths and the bit length of a block. Returns the size of this part of the block (that is, the 
+position of the packed code), or -1 if the block is not valid. */
+
+int read_block_header(const unsigned char *block, size_t block_size, unsigned char *lengths, uint64_t *bit_length){
+    int pos = read_code_lengths_header(block,block_size,lengths);
+    if(pos < 0) return -1;
+    int varint_size = read_varint(block+pos,block_size-pos,bit_length);
+    if(varint_size < 0) return -1;
+    pos += varint_size;
+    if((*bit_length+7)/8 > block_size-pos) return -1;
+    return pos;
+}
+
+/* Encodes the input string in a self-describing block and gives its size in *block_size. Empty strings are not
+supported (as in the encode function). */
+
+unsigned char *encode_canonical(char *input_string, size_t *block_size){
+    BW writer;
+    BW_initialize(&writer,strlen(input_string)/2);
+    *block_size = encode_block((unsigned char*)input_string,strlen(input_string),DEFAULT_MAX_CODE_LENGTH,&writer);
+    return writer.buffer;
+}
+
+/* Decodes a block produced by encode_canonical. Returns NULL if the block is not valid. */
+
+char *decode_canonical(unsigned char *block, size_t block_size){
+    unsigned char lengths[256];
+    Code codes[256];
+    uint64_t bit_length;
+    int pos = read_block_header(block,block_size,lengths,&bit_length);
+    if(pos < 0) return NULL;
+    assign_canonical_codes(lengths,codes);
+    DT *table = build_decode_table(codes);
+    if(!table) return NULL;
+    char *output = decode_with_table(block+pos,bit_length,table);
+    DT_free(table);
+    return output;
+}
+
+/* END OF CANONICAL CODES */
+
+
+/* CONTEXT MODELLING */
+
+/* A Huffman code gives each byte a code that depends only on the frequency of the byte in the whole block (an 
+"order-0" model). In text and in structured data, the next byte depends a lot on the previous one: after 'q' comes 'u',
+after '<' comes a letter, and so on. An "order-1" model uses a different code for each previous byte (the "context"), 
+so that the frequencies of each code are the ones of the bytes that follow the context. The decoder knows the previous
+byte, so it just switches to the decoding table of the context before decoding each byte. The context of the first 
+byte is 0.
+
+Each code costs a header in the block, which is more than the code saves if the context is rare. Hence a context only
+gets its own code when it saves more bits than the size of its header, compared with the order-0 code. The other 
+contexts share a single code, built from the bytes that follow all of them. Finally, if the whole block is not smaller
+than the order-0 block, we write the order-0 block instead.
+
+The block of an order-1 model has the following format:
+
+byte 0:                    1 if there is a shared code, 0 otherwise (2 is another kind of block, see INTERLEAVED STREAMS)
+byte 1:                    0 (this tells it from an order-0 block, whose byte 1 is a maximum code length)
+next 32 bytes:             one bit for each context (bit c%8 of byte c/8), set if the context has its own code
+code lengths headers       of the contexts that have their own code (in increasing order), then of the shared code
+bit length                 (varint)
+packed code
+
+Since the decoder switches tables after each byte, it uses the first symbol of each entry only. */
+
+#define CONTEXT_MAP_SIZE 32
+#define CONTEXT_SHARED 256 /* position of the shared code in the arrays of the model */
+
+typedef struct context_model{
+    unsigned int freq[257][256]; /* freq[c][s] is the number of times the byte s follows the context c */
+    unsigned char lengths[257][256];
+    Code codes[257][256];
+    int has_code[257]; /* the context has its own code (for the shared code: the shared code is used) */
+}CM; /* CM stands for Context Model */
+
+uint64_t code_bit_length(unsigned int *freq, unsigned char *lengths){
+    uint64_t bit_length = 0;
+    int s;
+    for(s=0;s<256;s++) bit_length += (uint64_t)freq[s]*lengths[s];
+    return bit_length;
+}
+
+int code_lengths_header_size(unsigned char *lengths){
+    unsigned char header[2+MAX_CODE_LENGTH+256];
+    return write_code_lengths_header(lengths,header);
+}
+
+int varint_size(uint64_t value){
+    unsigned char output[10];
+    return write_varint(value,output);
+}
+
+/* Builds the codes of the model and gives the size of its block, and the size of the order-0 block in *order0_size. */
+
+size_t build_context_model(const unsigned char *input, size_t size, int max_code_length, CM *model, size_t *order0_size){
+    unsigned int freq[256];
+    unsigned char lengths[256];
+    uint64_t bit_length = 0;
+    size_t i, block_size = 2+CONTEXT_MAP_SIZE;
+    int c, s, previous = 0;
+    memset(model->freq,0,sizeof(model->freq));
+    for(i=0;i<size;i++){
+        model->freq[previous][input[i]]++;
+        previous = input[i];
+    }
+    count_frequencies(input,size,freq);
+    build_code_lengths(freq,max_code_length,lengths);
+    bit_length = code_bit_length(freq,lengths);
+    *order0_size = code_lengths_header_size(lengths) + varint_size(bit_length) + (bit_length+7)/8;
+
+    bit_length = 0;
+    model->has_code[CONTEXT_SHARED] = 0;
+    for(c=0;c<256;c++){
+        uint64_t own_bits, shared_bits;
+        int header_size;
+        model->has_code[c] = 0;
+        build_code_lengths(model->freq[c],max_code_length,model->lengths[c]);
+        shared_bits = code_bit_length(model->freq[c],lengths);
+        if(shared_bits == 0) continue; /* the context does not occur */
+        header_size = code_lengths_header_size(model->lengths[c]);
+        own_bits = code_bit_length(model->freq[c],model->lengths[c]);
+        if(own_bits + 8*header_size < shared_bits){
+            model->has_code[c] = 1;
+            block_size += header_size;
+            bit_length += own_bits;
+            assign_canonical_codes(model->lengths[c],model->codes[c]);
+        }
+        else{
+            for(s=0;s<256;s++) model->freq[CONTEXT_SHARED][s] += model->freq[c][s];
+            model->has_code[CONTEXT_SHARED] = 1;
+        }
+    }
+    if(model->has_code[CONTEXT_SHARED]){
+        build_code_lengths(model->freq[CONTEXT_SHARED],max_code_length,model->lengths[CONTEXT_SHARED]);
+        assign_canonical_codes(model->lengths[CONTEXT_SHARED],model->codes[CONTEXT_SHARED]);
+        block_size += code_lengths_header_size(model->lengths[CONTEXT_SHARED]);
+        bit_length += code_bit_length(model->freq[CONTEXT_SHARED],model->lengths[CONTEXT_SHARED]);
+    }
+    return block_size + varint_size(bit_length) + (bit_length+7)/8;
+}
+
+/* It has the same usage as encode_block. */
+
+size_t encode_context_block(const unsigned char *input, size_t size, int max_code_length, BW *writer){
+    CM *model = (CM*)malloc(sizeof(CM));
+    Code *code_of[256];
+    size_t order0_size, block_size = build_context_model(input,size,max_code_length,model,&order0_size), i;
+    uint64_t bit_length = 0;
+    int c, previous = 0;
+    if(block_size >= order0_size){
+        free(model);
+        return encode_block(input,size,max_code_length,writer);
+    }
+
+    BW_reset(writer);
+    BW_reserve(writer,block_size);
+    unsigned char *output = writer->buffer;
+    output[0] = model->has_code[CONTEXT_SHARED];
+    output[1] = 0;
+    memset(output+2,0,CONTEXT_MAP_SIZE);
+    writer->byte_pos = 2+CONTEXT_MAP_SIZE;
+    for(c=0;c<=256;c++){
+        if(!model->has_code[c]) continue;
+        if(c < 256) output[2+c/8] |= 1 << (c%8);
+        writer->byte_pos += write_code_lengths_header(model->lengths[c],output+writer->byte_pos);
+        bit_length += code_bit_length(model->freq[c],model->lengths[c]);
+    }
+    for(c=0;c<256;c++) code_of[c] = model->has_code[c] ? model->codes[c] : model->codes[CONTEXT_SHARED];
+    writer->byte_pos += write_varint(bit_length,output+writer->byte_pos);
+    for(i=0;i<size;i++){
+        Code *code = &code_of[previous][input[i]];
+        BW_put_bits(writer,code->bits,code->length);
+        previous = input[i];
+    }
+    BW_flush(writer);
+    free(model);
+    return writer->byte_pos;
+}
+
+/* Reads the code lengths headers of a block written by encode_context_block and builds the decoding tables of the 
+codes (the tables must be NULL before the call). Returns the position of the bit length in the block, or -1 if the 
+headers are not valid. */
+
+long read_context_tables(const unsigned char *block, size_t block_size, DT **tables){
+    unsigned char lengths[256];
+    Code codes[256];
+    size_t pos = 2+CONTEXT_MAP_SIZE;
+    int c, size;
+    if(block_size < pos || block[0] > 1) return -1;
+    for(c=0;c<=256;c++){
+        if(c < 256 && !(block[2+c/8] & (1 << (c%8)))) continue;
+        if(c == 256 && !block[0]) continue;
+        size = read_code_lengths_header(block+pos,block_size-pos,lengths);
+        if(size < 0) return -1;
+        pos += size;
+        assign_canonical_codes(lengths,codes);
+        tables[c] = build_decode_table(codes);
+        if(!tables[c]) return -1;
+    }
+    return pos;
+}
+
+/* Decodes raw_size bytes, switching to the table of the previous byte before each one. Returns 0 on success or -1 if
+the code is not valid (or if it does not have exactly bit_length bits). */
+
+int decode_context_symbols(const unsigned char *encoded_bytes, uint64_t bit_length, DT **table_of, unsigned char *output, size_t raw_size){
+    uint64_t bits_read = 0;
+    size_t j;
+    int previous = 0;
+    BR reader;
+    BR_initialize(&reader,encoded_bytes,(bit_length+7)/8);
+    for(j=0;j<raw_size;j++){
+        DT *table = table_of[previous];
+        if(!table) return -1;
+        DEntry *entry = &table->entries[BR_peek_bits(&reader,DECODE_TABLE_BITS)];
+        if(entry->num_symbols == 0){
+            uint64_t index = BR_peek_bits(&reader,DECODE_TABLE_BITS+entry->sub_bits) & ((1 << entry->sub_bits)-1);
+            entry = &table->entries[entry->sub_offset + index];
+        }
+        if(entry->length == 0 || entry->first_length > bit_length-bits_read) return -1;
+        BR_consume_bits(&reader,entry->first_length);
+        bits_read += entry->first_length;
+        output[j] = previous = entry->symbols[0];
+    }
+    if(bits_read != bit_length) return -1;
+    return 0;
+}
+
+/* Decodes a block written by encode_context_block (with byte 1 equal to 0) into the output, which must have room for 
+raw_size bytes. Returns 0 on success or -1 if the block is not valid. */
+
+int decode_context_block(const unsigned char *block, size_t block_size, unsigned char *output, size_t raw_size){
+    DT *tables[257], *table_of[256];
+    uint64_t bit_length;
+    int c, result = -1;
+    for(c=0;c<=256;c++) tables[c] = NULL;
+    long pos = read_context_tables(block,block_size,tables);
+    if(pos >= 0){
+        int size = read_varint(block+pos,block_size-pos,&bit_length);
+        if(size >= 0 && (bit_length+7)/8 <= block_size-pos-size){
+            for(c=0;c<256;c++) table_of[c] = tables[c] ? tables[c] : tables[CONTEXT_SHARED];
+            result = decode_context_symbols(block+pos+size,bit_length,table_of,output,raw_size);
+        }
+    }
+    for(c=0;c<=256;c++) DT_free(tables[c]);
+    return result;
+}
+
+/* END OF CONTEXT MODELLING */
+
+
+/* INTERLEAVED STREAMS */
+
+/* The table decoder is limited by latency, not by the amount of work: to know where the code of a symbol starts, we 
+must have finished decoding the previous symbol (the lookup, then the shift of the bit buffer). The processor could do
+several lookups at the same time, but there is no other independent work to do.
+
+So we make independent work: the symbols of the block are split in 4 "lanes" (the symbol i goes to the lane i%4), and 
+each lane is written as a separate bit stream, with the same code. The decoder keeps 4 bit readers and, in each step of 
+its loop, decodes one symbol of each stream, which gives the next 4 bytes of the output. The 4 decodings do not depend
+on each other, so the processor overlaps them. The cost is a few bytes per block, so we only do it for blocks of at 
+least INTERLEAVED_MIN_SIZE bytes.
+
+The block has the following format:
+
+byte 0:                    INTERLEAVED_BLOCK
+byte 1:                    0 (as the blocks of CONTEXT MODELLING)
+code lengths header        as in an order-0 block
+bit lengths                of the 4 streams (varints)
+4 streams                  each one padded to a whole number of bytes */
+
+#define INTERLEAVED_BLOCK 2
+#define INTERLEAVED_STREAMS 4
+#define INTERLEAVED_MIN_SIZE (1 << 14)
+
+/* Writes the codes of input[lane], input[lane+4], ... (see BW_put_codes). */
+
+void BW_put_lane_codes(BW *w, const unsigned char *input, size_t size, size_t lane, Code *codes){
+    uint64_t bit_buffer = w->bit_buffer;
+    int bit_count = w->bit_count;
+    unsigned char *output = w->buffer+w->byte_pos;
+    size_t i;
+    for(i=lane;i<size;i+=INTERLEAVED_STREAMS){
+        Code code = codes[input[i]];
+        bit_buffer = (bit_buffer << code.length) | code.bits;
+        bit_count += code.length;
+        if(bit_count >= 32){
+            bit_count -= 32;
+            uint32_t word = (uint32_t)(bit_buffer >> bit_count);
+            output[0] = word >> 24;
+            output[1] = word >> 16;
+            output[2] = word >> 8;
+            output[3] = word;
+            output += 4;
+        }
+    }
+    w->bit_buffer = bit_buffer;
+    w->bit_count = bit_count;
+    w->byte_pos = output-w->buffer;
+}
+
+/* It has the same usage as encode_block. */
+
+size_t encode_interleaved_block(const unsigned char *input, size_t size, int max_code_length, BW *writer){
+    unsigned int histograms[INTERLEAVED_STREAMS][256], freq[256];
+    unsigned char lengths[256];
+    Code codes[256];
+    uint64_t bit_lengths[INTERLEAVED_STREAMS], total_bytes = 0;
+    int s, c;
+    count_lane_frequencies(input,size,histograms);
+    for(c=0;c<256;c++) freq[c] = histograms[0][c] + histograms[1][c] + histograms[2][c] + histograms[3][c];
+    build_code_lengths(freq,max_code_length,lengths);
+    assign_canonical_codes(lengths,codes);
+    for(s=0;s<INTERLEAVED_STREAMS;s++){
+        bit_lengths[s] = code_bit_length(histograms[s],lengths);
+        total_bytes += (bit_lengths[s]+7)/8;
+    }
+
+    BW_reset(writer);
+    BW_reserve(writer,2+2+MAX_CODE_LENGTH+256+INTERLEAVED_STREAMS*10+total_bytes+4);
+    writer->buffer[0] = INTERLEAVED_BLOCK;
+    writer->buffer[1] = 0;
+    writer->byte_pos = 2 + write_code_lengths_header(lengths,writer->buffer+2);
+    for(s=0;s<INTERLEAVED_STREAMS;s++) writer->byte_pos += write_varint(bit_lengths[s],writer->buffer+writer->byte_pos);
+    for(s=0;s<INTERLEAVED_STREAMS;s++){
+        /* Each stream is written by a writer of its own, which starts where the previous stream ends. The writer has 
+        room for 4 more bytes (they belong to the next stream, which is written afterwards), so BW_flush does not need
+        to grow it. */
+        BW lane;
+        lane.buffer = writer->buffer+writer->byte_pos;
+        lane.capacity = (bit_lengths[s]+7)/8 + 4;
+        BW_reset(&lane);
+        BW_put_lane_codes(&lane,input,size,s,codes);
+        BW_flush(&lane);
+        writer->byte_pos += lane.byte_pos;
+    }
+    return writer->byte_pos;
+}
+
+DEntry *DT_lookup(DT *table, BR *reader){
+    DEntry *entry = &table->entries[BR_peek_bits(reader,DECODE_TABLE_BITS)];
+    if(entry->num_symbols == 0){
+        uint64_t index = BR_peek_bits(reader,DECODE_TABLE_BITS+entry->sub_bits) & ((1 << entry->sub_bits)-1);
+        entry = &table->entries[entry->sub_offset + index];
+    }
+    return entry;
+}
+
+/* Decodes raw_size bytes from the 4 streams. The readers return zeros after the end of their streams, so the loop does
+not check the lengths: we only check at the end that each stream had exactly the right number of bits (and that no 
+invalid entry was found). Returns 0 on success or -1 if the streams are not valid.
+
+The main loop is written for speed. The state of the 4 readers is copied to local variables, so that the compiler 
+can keep it in registers (the stores to the output could change the readers, as far as the compiler knows, if they 
+were in memory). After a refill, each window has at least 57 bits, which is enough for two codes (of at most 
+BLOCK_MAX_CODE_LENGTH bits), so each step of the loop refills the 4 windows once and decodes 8 symbols. Near the end of
+the streams (where a refill cannot read 8 bytes at once), we go on with the usual functions of the readers. */
+
+int decode_interleaved_symbols(const unsigned char **streams, uint64_t *bit_lengths, DT *table, unsigned char *output, size_t raw_size){
+    BR readers[INTERLEAVED_STREAMS];
+    DEntry *entries = table->entries;
+    size_t j = 0;
+    int s, invalid = 0;
+    for(s=0;s<INTERLEAVED_STREAMS;s++) BR_initialize(&readers[s],streams[s],(bit_lengths[s]+7)/8);
+
+    uint64_t window0 = 0, window1 = 0, window2 = 0, window3 = 0;
+    int count0 = 0, count1 = 0, count2 = 0, count3 = 0;
+    size_t pos0 = 0, pos1 = 0, pos2 = 0, pos3 = 0;
+    size_t end0 = readers[0].size, end1 = readers[1].size, end2 = readers[2].size, end3 = readers[3].size;
+    const unsigned char *in0 = streams[0], *in1 = streams[1], *in2 = streams[2], *in3 = streams[3];
+    while(j+2*INTERLEAVED_STREAMS <= raw_size && pos0+8 <= end0 && pos1+8 <= end1 && pos2+8 <= end2 && pos3+8 <= end3){
+        int k;
+        window0 |= load_big_endian_64(in0+pos0) >> count0; pos0 += (63-count0) >> 3; count0 |= 56;
+        window1 |= load_big_endian_64(in1+pos1) >> count1; pos1 += (63-count1) >> 3; count1 |= 56;
+        window2 |= load_big_endian_64(in2+pos2) >> count2; pos2 += (63-count2) >> 3; count2 |= 56;
+        window3 |= load_big_endian_64(in3+pos3) >> count3; pos3 += (63-count3) >> 3; count3 |= 56;
+        for(k=0;k<2;k++){
+            DEntry *entry0 = &entries[window0 >> (64-DECODE_TABLE_BITS)];
+            DEntry *entry1 = &entries[window1 >> (64-DECODE_TABLE_BITS)];
+            DEntry *entry2 = &entries[window2 >> (64-DECODE_TABLE_BITS)];
+            DEntry *entry3 = &entries[window3 >> (64-DECODE_TABLE_BITS)];
+            if(entry0->num_symbols == 0) entry0 = &entries[entry0->sub_offset + ((window0 >> (64-DECODE_TABLE_BITS-entry0->sub_bits)) & ((1 << entry0->sub_bits)-1))];
+            if(entry1->num_symbols == 0) entry1 = &entries[entry1->sub_offset + ((window1 >> (64-DECODE_TABLE_BITS-entry1->sub_bits)) & ((1 << entry1->sub_bits)-1))];
+            if(entry2->num_symbols == 0) entry2 = &entries[entry2->sub_offset + ((window2 >> (64-DECODE_TABLE_BITS-entry2->sub_bits)) & ((1 << entry2->sub_bits)-1))];
+            if(entry3->num_symbols == 0) entry3 = &entries[entry3->sub_offset + ((window3 >> (64-DECODE_TABLE_BITS-entry3->sub_bits)) & ((1 << entry3->sub_bits)-1))];
+            invalid |= (entry0->length == 0) | (entry1->length == 0) | (entry2->length == 0) | (entry3->length == 0);
+            window0 <<= entry0->first_length; count0 -= entry0->first_length;
+            window1 <<= entry1->first_length; count1 -= entry1->first_length;
+            window2 <<= entry2->first_length; count2 -= entry2->first_length;
+            window3 <<= entry3->first_length; count3 -= entry3->first_length;
+            output[j] = entry0->symbols[0];
+            output[j+1] = entry1->symbols[0];
+            output[j+2] = entry2->symbols[0];
+            output[j+3] = entry3->symbols[0];
+            j += INTERLEAVED_STREAMS;
+        }
+    }
+    readers[0].bit_buffer = window0; readers[0].bit_count = count0; readers[0].byte_pos = pos0;
+    readers[1].bit_buffer = window1; readers[1].bit_count = count1; readers[1].byte_pos = pos1;
+    readers[2].bit_buffer = window2; readers[2].bit_count = count2; readers[2].byte_pos = pos2;
+    readers[3].bit_buffer = window3; readers[3].bit_count = count3; readers[3].byte_pos = pos3;
+
+    for(s=0;j<raw_size;j++,s=(s+1)%INTERLEAVED_STREAMS){
+        DEntry *entry = DT_lookup(table,&readers[s]);
+        invalid |= entry->length == 0;
+        output[j] = entry->symbols[0];
+        BR_consume_bits(&readers[s],entry->first_length);
+    }
+    if(invalid) return -1;
+    /* The bits consumed by a reader are the bits it took from the stream minus the bits still in its window. */
+    for(s=0;s<INTERLEAVED_STREAMS;s++){
+        if(8*(uint64_t)readers[s].byte_pos - readers[s].bit_count != bit_lengths[s]) return -1;
+    }
+    return 0;
+}
+
+/* Reads the code lengths, the bit lengths and the positions of the streams of a block written by 
+encode_interleaved_block. Returns 0, or -1 if the block is not valid. */
+
+int read_interleaved_header(const unsigned char *block, size_t block_size, unsigned char *lengths, uint64_t *bit_lengths, const unsigned char **streams){
+    int s, size;
+    if(block_size < 2 || block[0] != INTERLEAVED_BLOCK || block[1] != 0) return -1;
+    size_t pos = 2;
+    size = read_code_lengths_header(block+pos,block_size-pos,lengths);
+    if(size < 0) return -1;
+    pos += size;
+    for(s=0;s<INTERLEAVED_STREAMS;s++){
+        size = read_varint(block+pos,block_size-pos,&bit_lengths[s]);
+        if(size < 0) return -1;
+        pos += size;
+    }
+    for(s=0;s<INTERLEAVED_STREAMS;s++){
+        if((bit_lengths[s]+7)/8 > block_size-pos) return -1;
+        streams[s] = block+pos;
+        pos += (bit_lengths[s]+7)/8;
+    }
+    return 0;
+}
+
+/* Decodes a block written by encode_interleaved_block into the output, which must have room for raw_size bytes. 
+Returns 0 on success or -1 if the block is not valid. */
+
+int decode_interleaved_block(const unsigned char *block, size_t block_size, unsigned char *output, size_t raw_size){
+    unsigned char lengths[256];
+    Code codes[256];
+    uint64_t bit_lengths[INTERLEAVED_STREAMS];
+    const unsigned char *streams[INTERLEAVED_STREAMS];
+    if(read_interleaved_header(block,block_size,lengths,bit_lengths,streams) < 0) return -1;
+    assign_canonical_codes(lengths,codes);
+    DT *table = build_decode_table(codes);
+    if(!table) return -1;
+    int result = decode_interleaved_symbols(streams,bit_lengths,table,output,raw_size);
+    DT_free(table);
+    return result;
+}
+
+/* END OF INTERLEAVED STREAMS */
+
+
+/* STREAMING COMPRESSION */
+
+/* To compress large files, we cannot read the whole input in memory. Instead, we split the input in blocks of a fixed 
+size, and each block is compressed independently (with its own frequencies and its own codes) by encode_block. Thus,
+the memory used does not depend on the size of the input.
+
+The compressed file has the following format (a "framed" format):
+
+"HUF1"                   (4 bytes, to recognize the file)
+frames                   one for each block
+0                        (1 byte, the end of the frames)
+block index              (see below)
+
+where a frame is:
+
+raw size                 (varint) number of bytes of the original block
+block size               (varint) number of bytes of the compressed block
+block                    (block size bytes) as written by encode_block (or encode_context_block, or 
+                         encode_interleaved_block for blocks of at least INTERLEAVED_MIN_SIZE bytes)
+
+The block index gives the position of each frame in the file, so that the blocks can be decoded in any order (and in 
+parallel). All its numbers have 8 bytes (least significant byte first):
+
+number of blocks (n)
+n+1 pairs                (position of the frame in the file, position of the block in the original data); the last
+                         pair gives the position of the end of the frames and the size of the original data
+position of the index
+"HIDX"                   (4 bytes)
+
+A decoder that reads the frames in sequence just stops at the end of the frames and never looks at the index.
+
+The streaming API has three functions. HS_compress_init writes the beginning of the file, HS_compress_feed receives 
+any amount of input (it writes a frame whenever a block is full) and HS_compress_finish writes the last block and the
+end of the file. Do as below:
+
+HS *stream = HS_compress_init(output_file,HS_DEFAULT_BLOCK_SIZE,DEFAULT_MAX_CODE_LENGTH,model_order);
+HS_compress_feed(stream,data,size);       (as many times as needed)
+HS_compress_finish(stream);
+
+where model_order is 0 (one code per block) or 1 (one code per context, see CONTEXT MODELLING). These functions 
+return 0 on success and -1 on failure (they fail if the output cannot be written). */
+
+#define HS_MAGIC "HUF1"
+#define HS_DEFAULT_BLOCK_SIZE (1 << 20)
+#define HS_MAX_BLOCK_SIZE (1 << 30)
+#define BLOCK_HEADER_MAX_SIZE (2+MAX_CODE_LENGTH+256+10)
+
+#define HS_INDEX_MAGIC "HIDX"
+
+typedef struct huffman_stream{
+    FILE *output;
+    unsigned char *block; /* the input of the current block */
+    size_t block_size; /* maximum number of input bytes per block */
+    size_t filled; /* number of input bytes in the current block */
+    int max_code_length;
+    int model_order;
+    BW writer;
+    uint64_t written, raw_written; /* bytes written to the output, and bytes of input they contain */
+    uint64_t *index; /* pairs (position of the frame, position of the block in the input) */
+    size_t num_blocks, index_capacity;
+}HS; /* HS stands for Huffman Stream */
+
+HS *HS_compress_init(FILE *output, size_t block_size, int max_code_length, int model_order){
+    if(block_size == 0 || block_size > HS_MAX_BLOCK_SIZE || model_order < 0 || model_order > 1) return NULL;
+    if(max_code_length < MIN_CODE_LENGTH_LIMIT || max_code_length > BLOCK_MAX_CODE_LENGTH) return NULL;
+    if(fwrite(HS_MAGIC,1,4,output) != 4) return NULL;
+    HS *stream = (HS*)malloc(sizeof(HS));
+    stream->output = output;
+    stream->block = (unsigned char*)malloc(block_size);
+    stream->block_size = block_size;
+    stream->filled = 0;
+    stream->max_code_length = max_code_length;
+    stream->model_order = model_order;
+    BW_initialize(&stream->writer,block_size+BLOCK_HEADER_MAX_SIZE);
+    stream->written = 4;
+    stream->raw_written = 0;
+    stream->index_capacity = 64;
+    stream->index = (uint64_t*)malloc(2*stream->index_capacity*sizeof(uint64_t));
+    stream->num_blocks = 0;
+    return stream;
+}
+
+/* Writes a frame containing an already compressed block, and records it in the index. */
+
+int HS_append_frame(HS *stream, size_t raw_size, unsigned char *block, size_t block_size){
+    unsigned char sizes[20];
+    int pos = write_varint(raw_size,sizes);
+    pos += write_varint(block_size,sizes+pos);
+    if(fwrite(sizes,1,pos,stream->output) != (size_t)pos) return -1;
+    if(fwrite(block,1,block_size,stream->output) != block_size) return -1;
+    if(stream->num_blocks == stream->index_capacity){
+        stream->index_capacity *= 2;
+        stream->index = (uint64_t*)realloc(stream->index,2*stream->index_capacity*sizeof(uint64_t));
+    }
+    stream->index[2*stream->num_blocks] = stream->written;
+    stream->index[2*stream->num_blocks+1] = stream->raw_written;
+    stream->num_blocks++;
+    stream->written += pos+block_size;
+    stream->raw_written += raw_size;
+    return 0;
+}
+
+/* Encodes the input with the given model order and returns the size of the block (see encode_block). */
+
+size_t encode_model_block(const unsigned char *input, size_t size, int max_code_length, int model_order, BW *writer){
+    if(model_order == 1) return encode_context_block(input,size,max_code_length,writer);
+    if(size >= INTERLEAVED_MIN_SIZE) return encode_interleaved_block(input,size,max_code_length,writer);
+    return encode_block(input,size,max_code_length,writer);
+}
+
+int HS_write_block(HS *stream, const unsigned char *data, size_t size){
+    if(size == 0) return 0;
+    size_t block_size = encode_model_block(data,size,stream->max_code_length,stream->model_order,&stream->writer);
+    return HS_append_frame(stream,size,stream->writer.buffer,block_size);
+}
+
+void write_u64(uint64_t value, unsigned char *output){
+    int i;
+    for(i=0;i<8;i++) output[i] = value >> (8*i);
+}
+
+uint64_t read_u64(const unsigned char *input){
+    uint64_t value = 0;
+    int i;
+    for(i=7;i>=0;i--) value = (value << 8) | input[i];
+    return value;
+}
+
+int HS_write_index(HS *stream){
+    unsigned char number[8];
+    size_t i;
+    uint64_t index_position = stream->written;
+    write_u64(stream->num_blocks,number);
+    if(fwrite(number,1,8,stream->output) != 8) return -1;
+    for(i=0;i<=stream->num_blocks;i++){
+        uint64_t frame_position = i < stream->num_blocks ? stream->index[2*i] : stream->written-1;
+        uint64_t raw_position = i < stream->num_blocks ? stream->index[2*i+1] : stream->raw_written;
+        write_u64(frame_position,number);
+        if(fwrite(number,1,8,stream->output) != 8) return -1;
+        write_u64(raw_position,number);
+        if(fwrite(number,1,8,stream->output) != 8) return -1;
+    }
+    write_u64(index_position,number);
+    if(fwrite(number,1,8,stream->output) != 8) return -1;
+    if(fwrite(HS_INDEX_MAGIC,1,4,stream->output) != 4) return -1;
+    return 0;
+}
+
+/* The input is copied to the block of the stream only when it does not fill a whole block: the whole blocks are encoded 
+where they are. Hence feeding a big buffer (for instance, a memory-mapped file) does not copy it. */
+
+int HS_compress_feed(HS *stream, const unsigned char *data, size_t size){
+    while(size > 0){
+        if(stream->filled == 0 && size >= stream->block_size){
+            if(HS_write_block(stream,data,stream->block_size) < 0) return -1;
+            data += stream->block_size;
+            size -= stream->block_size;
+            continue;
+        }
+        size_t amount = stream->block_size-stream->filled;
+        if(amount > size) amount = size;
+        memcpy(stream->block+stream->filled,data,amount);
+        stream->filled += amount;
+        data += amount;
+        size -= amount;
+        if(stream->filled == stream->block_size){
+            stream->filled = 0;
+            if(HS_write_block(stream,stream->block,stream->block_size) < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+/* Writes the last block and the end of the file, and frees the stream (even on failure). */
+
+int HS_compress_finish(HS *stream){
+    int result = HS_write_block(stream,stream->block,stream->filled);
+    if(result == 0 && fputc(0,stream->output) == EOF) result = -1;
+    stream->written++;
+    if(result == 0) result = HS_write_index(stream);
+    if(result == 0 && fflush(stream->output) != 0) result = -1;
+    free(stream->block);
+    free(stream->writer.buffer);
+    free(stream->index);
+    free(stream);
+    return result;
+}
+
+#define FILE_CHUNK_SIZE (1 << 16)
+
+int compress_file(FILE *input, FILE *output, size_t block_size, int max_code_length, int model_order){
+    unsigned char chunk[FILE_CHUNK_SIZE];
+    size_t size;
+    HS *stream = HS_compress_init(output,block_size,max_code_length,model_order);
+    if(!stream) return -1;
+    while((size = fread(chunk,1,FILE_CHUNK_SIZE,input)) > 0){
+        if(HS_compress_feed(stream,chunk,size) < 0){
+            HS_compress_finish(stream);
+            return -1;
+        }
+    }
+    if(ferror(input)){
+        HS_compress_finish(stream);
+        return -1;
+    }
+    return HS_compress_finish(stream);
+}
+
+/* Returns 0 on success, or -1 if the file ends before the varint. */
+
+int fread_varint(FILE *input, uint64_t *value){
+    int c, shift = 0;
+    *value = 0;
+    while(shift < 64 && (c = fgetc(input)) != EOF){
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        if(!(c & 0x80)) return 0;
+        shift += 7;
+    }
+    return -1;
+}
+
+/* Decodes one block (of an order-0 or order-1 model) into the output, which must have room for raw_size bytes. Returns
+0 on success or -1 if the block is not valid. */
+
+int decode_block(const unsigned char *block, size_t block_size, unsigned char *output, size_t raw_size){
+    unsigned char lengths[256];
+    Code codes[256];
+    uint64_t bit_length;
+    if(block_size >= 2 && block[1] == 0){
+        if(block[0] == INTERLEAVED_BLOCK) return decode_interleaved_block(block,block_size,output,raw_size);
+        return decode_context_block(block,block_size,output,raw_size);
+    }
+    int pos = read_block_header(block,block_size,lengths,&bit_length);
+    if(pos < 0) return -1;
+    assign_canonical_codes(lengths,codes);
+    DT *table = build_decode_table(codes);
+    if(!table) return -1;
+    long size = decode_symbols(block+pos,bit_length,table,output,raw_size);
+    DT_free(table);
+    if(size != (long)raw_size) return -1;
+    return 0;
+}
+
+/* The decompression reads one frame at a time, so it also uses a bounded amount of memory. Returns 0 on success or -1 if
+the input is not a valid compressed file (or if the output cannot be written). */
+
+int decompress_file(FILE *input, FILE *output){
+    char magic[4];
+    unsigned char *block = NULL, *raw = NULL;
+    size_t block_capacity = 0, raw_capacity = 0;
+    uint64_t raw_size, block_size;
+    int result = -1;
+    if(fread(magic,1,4,input) != 4 || memcmp(magic,HS_MAGIC,4) != 0) return -1;
+    while(1){
+        if(fread_varint(input,&raw_size) < 0) break;
+        if(raw_size == 0){
+            result = fflush(output) == 0 ? 0 : -1;
+            break;
+        }
+        if(raw_size > HS_MAX_BLOCK_SIZE || fread_varint(input,&block_size) < 0) break;
+        if(block_size > 2*raw_size+BLOCK_HEADER_MAX_SIZE) break;
+        if(block_size > block_capacity){
+            block_capacity = block_size;
+            block = (unsigned char*)realloc(block,block_capacity);
+        }
+        if(raw_size > raw_capacity){
+            raw_capacity = raw_size;
+            raw = (unsigned char*)realloc(raw,raw_capacity);
+        }
+        if(fread(block,1,block_size,input) != block_size) break;
+        if(decode_block(block,block_size,raw,raw_size) < 0) break;
+        if(fwrite(raw,1,raw_size,output) != raw_size) break;
+    }
+    free(block);
+    free(raw);
+    return result;
+}
+
+/* END OF STREAMING COMPRESSION */
+
+
+/* PARALLEL COMPRESSION */
+
+/* The blocks are independent, so they can be compressed (and decompressed) at the same time by different threads. 
+We use a "thread pool": a fixed number of threads which wait for jobs in a queue. A job is a function together with 
+its argument. TP_wait waits until all the submitted jobs are finished. */
+
+typedef struct job{
+    void (*function)(void*);
+    void *argument;
+}Job;
+
+typedef struct thread_pool{
+    pthread_t *threads;
+    int num_threads;
+    Job *jobs; /* circular queue of jobs */
+    int capacity, head, count;
+    int unfinished; /* jobs submitted and not finished yet */
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_available, job_finished;
+}TP; /* TP stands for Thread Pool */
+
+void *TP_worker(void *argument){
+    TP *pool = (TP*)argument;
+    while(1){
+        pthread_mutex_lock(&pool->mutex);
+        while(pool->count == 0 && !pool->stop) pthread_cond_wait(&pool->job_available,&pool->mutex);
+        if(pool->count == 0){
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        Job job = pool->jobs[pool->head];
+        pool->head = (pool->head+1) % pool->capacity;
+        pool->count--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        job.function(job.argument);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->unfinished--;
+        if(pool->unfinished == 0) pthread_cond_broadcast(&pool->job_finished);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+TP *TP_create(int num_threads, int capacity){
+    TP *pool = (TP*)malloc(sizeof(TP));
+    int i;
+    pool->threads = (pthread_t*)malloc(num_threads*sizeof(pthread_t));
+    pool->jobs = (Job*)malloc(capacity*sizeof(Job));
+    pool->capacity = capacity;
+    pool->head = 0;
+    pool->count = 0;
+    pool->unfinished = 0;
+    pool->stop = 0;
+    pthread_mutex_init(&pool->mutex,NULL);
+    pthread_cond_init(&pool->job_available,NULL);
+    pthread_cond_init(&pool->job_finished,NULL);
+    pool->num_threads = 0;
+    for(i=0;i<num_threads;i++){
+        if(pthread_create(&pool->threads[i],NULL,TP_worker,pool) != 0) break;
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+/* The queue must not be full (we never submit more jobs than its capacity before calling TP_wait). */
+
+void TP_submit(TP *pool, void (*function)(void*), void *argument){
+    pthread_mutex_lock(&pool->mutex);
+    pool->jobs[(pool->head+pool->count) % pool->capacity].function = function;
+    pool->jobs[(pool->head+pool->count) % pool->capacity].argument = argument;
+    pool->count++;
+    pool->unfinished++;
+    pthread_cond_signal(&pool->job_available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void TP_wait(TP *pool){
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->unfinished > 0) pthread_cond_wait(&pool->job_finished,&pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void TP_destroy(TP *pool){
+    int i;
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->job_available);
+    pthread_mutex_unlock(&pool->mutex);
+    for(i=0;i<pool->num_threads;i++) pthread_join(pool->threads[i],NULL);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->job_available);
+    pthread_cond_destroy(&pool->job_finished);
+    free(pool->threads);
+    free(pool->jobs);
+    free(pool);
+}
+
+/* The main thread reads a batch of blocks (two per thread), the pool compresses them, and then the main thread writes 
+them in order. Each block of the batch has its own buffers, which are reused from one batch to the next. */
+
+typedef struct block_job{
+    unsigned char *raw; /* original data */
+    size_t raw_size;
+    unsigned char *block; /* compressed data (decompression only; the compression uses the writer) */
+    size_t block_size;
+    BW writer;
+    int max_code_length, model_order;
+    int result;
+}BJ; /* BJ stands for Block Job */
+
+void compress_block_job(void *argument){
+    BJ *job = (BJ*)argument;
+    job->block_size = encode_model_block(job->raw,job->raw_size,job->max_code_length,job->model_order,&job->writer);
+}
+
+int compress_file_parallel(FILE *input, FILE *output, size_t block_size, int max_code_length, int model_order, int num_threads){
+    int batch_size = 2*num_threads, i, num_jobs, result = 0;
+    HS *stream = HS_compress_init(output,block_size,max_code_length,model_order);
+    if(!stream) return -1;
+    TP *pool = TP_create(num_threads,batch_size);
+    BJ *jobs = (BJ*)malloc(batch_size*sizeof(BJ));
+    for(i=0;i<batch_size;i++){
+        jobs[i].raw = (unsigned char*)malloc(block_size);
+        jobs[i].max_code_length = max_code_length;
+        jobs[i].model_order = model_order;
+        BW_initialize(&jobs[i].writer,block_size+BLOCK_HEADER_MAX_SIZE);
+    }
+    do{
+        for(num_jobs=0;num_jobs<batch_size;num_jobs++){
+            jobs[num_jobs].raw_size = fread(jobs[num_jobs].raw,1,block_size,input);
+            if(jobs[num_jobs].raw_size == 0) break;
+            TP_submit(pool,compress_block_job,&jobs[num_jobs]);
+        }
+        TP_wait(pool);
+        for(i=0;i<num_jobs && result == 0;i++){
+            result = HS_append_frame(stream,jobs[i].raw_size,jobs[i].writer.buffer,jobs[i].block_size);
+        }
+    }while(num_jobs == batch_size && result == 0);
+    if(ferror(input)) result = -1;
+    TP_destroy(pool);
+    for(i=0;i<batch_size;i++){
+        free(jobs[i].raw);
+        free(jobs[i].writer.buffer);
+    }
+    free(jobs);
+    if(HS_compress_finish(stream) < 0) result = -1;
+    return result;
+}
+
+/* To decompress in parallel, we read the block index at the end of the file. Each job reads its own frame (with pread, 
+so the threads do not share a file position) and decodes it. Returns 1 if the input has no valid index (for example, 
+if it is not a regular file), so the caller may decompress it sequentially. */
+
+typedef struct parallel_decoding{
+    int fd;
+    off_t start; /* position of the stream in the file: the positions of the index are relative to it */
+    uint64_t *index;
+}PD;
+
+typedef struct frame_job{
+    BJ data;
+    size_t block_capacity, raw_capacity; /* the buffers only grow */
+    PD *decoding;
+    size_t block_number;
+}FJ; /* FJ stands for Frame Job */
+
+void decompress_frame_job(void *argument){
+    FJ *job = (FJ*)argument;
+    uint64_t frame_position = job->decoding->index[2*job->block_number];
+    uint64_t frame_size = job->decoding->index[2*job->block_number+2]-frame_position;
+    uint64_t raw_size = job->decoding->index[2*job->block_number+3]-job->decoding->index[2*job->block_number+1];
+    uint64_t stored_raw_size, block_size;
+    int pos, size;
+    job->data.result = -1;
+    if(pread(job->decoding->fd,job->data.block,frame_size,job->decoding->start+frame_position) != (ssize_t)frame_size) return;
+    pos = read_varint(job->data.block,frame_size,&stored_raw_size);
+    if(pos < 0 || stored_raw_size != raw_size) return;
+    size = read_varint(job->data.block+pos,frame_size-pos,&block_size);
+    if(size < 0 || block_size != frame_size-pos-size) return;
+    pos += size;
+    job->data.raw_size = raw_size;
+    job->data.result = decode_block(job->data.block+pos,block_size,job->data.raw,raw_size);
+}
+
+/* The stream starts at the position start of the file and goes to its end. */
+
+uint64_t *parse_block_index(FILE *input, off_t start, size_t *num_blocks){
+    unsigned char trailer[12], number[8];
+    uint64_t index_position, end, i;
+    if(fseeko(input,0,SEEK_END) != 0 || ftello(input) < start) return NULL;
+    end = ftello(input)-start;
+    if(end < 4+1+8+16+12 || fseeko(input,start+end-12,SEEK_SET) != 0 || fread(trailer,1,12,input) != 12) return NULL;
+    if(memcmp(trailer+8,HS_INDEX_MAGIC,4) != 0) return NULL;
+    index_position = read_u64(trailer);
+    if(index_position > end-12 || fseeko(input,start+index_position,SEEK_SET) != 0 || fread(number,1,8,input) != 8) return NULL;
+    *num_blocks = read_u64(number);
+    if(*num_blocks != (end-12-index_position-8)/16-1 || (end-12-index_position-8) % 16 != 0) return NULL;
+    uint64_t *index = (uint64_t*)malloc(2*(*num_blocks+1)*sizeof(uint64_t));
+    for(i=0;i<2*(*num_blocks+1);i++){
+        if(fread(number,1,8,input) != 8){
+            free(index);
+            return NULL;
+        }
+        index[i] = read_u64(number);
+    }
+    /* The frames must follow each other, and the blocks must not be larger than HS_MAX_BLOCK_SIZE. */
+    if(index[0] != 4 || index[1] != 0 || index[2*(*num_blocks)] >= index_position) {
+        free(index);
+        return NULL;
+    }
+    for(i=0;i<*num_blocks;i++){
+        if(index[2*i+2] <= index[2*i] || index[2*i+3] <= index[2*i+1] || index[2*i+3]-index[2*i+1] > HS_MAX_BLOCK_SIZE){
+            free(index);
+            return NULL;
+        }
+    }
+    return index;
+}
+
+/* The stream starts at the current position of the input, which is not always the beginning of the file (for example, 
+the standard input may be redirected from a file which was already partly read). This position is given in *start, and 
+the positions of the index are relative to it. Returns NULL if the input has no valid index. In that case the input is 
+back at its original position, so that it can still be decompressed sequentially. */
+
+uint64_t *read_block_index(FILE *input, off_t *start, size_t *num_blocks){
+    *start = ftello(input);
+    if(*start < 0) return NULL;
+    uint64_t *index = parse_block_index(input,*start,num_blocks);
+    if(!index) fseeko(input,*start,SEEK_SET);
+    return index;
+}
+
+int decompress_file_parallel(FILE *input, FILE *output, int num_threads){
+    size_t num_blocks, next = 0, i;
+    int batch_size = 2*num_threads, num_jobs, result = 0;
+    PD decoding;
+    decoding.index = read_block_index(input,&decoding.start,&num_blocks);
+    if(!decoding.index) return 1;
+    decoding.fd = fileno(input);
+    TP *pool = TP_create(num_threads,batch_size);
+    FJ *jobs = (FJ*)malloc(batch_size*sizeof(FJ));
+    for(i=0;i<(size_t)batch_size;i++){
+        jobs[i].decoding = &decoding;
+        jobs[i].data.raw = NULL;
+        jobs[i].data.block = NULL;
+        jobs[i].block_capacity = 0;
+        jobs[i].raw_capacity = 0;
+    }
+    while(next < num_blocks && result == 0){
+        for(num_jobs=0;num_jobs<batch_size && next < num_blocks;num_jobs++,next++){
+            FJ *job = &jobs[num_jobs];
+            uint64_t frame_size = decoding.index[2*next+2]-decoding.index[2*next];
+            uint64_t raw_size = decoding.index[2*next+3]-decoding.index[2*next+1];
+            if(frame_size > 2*raw_size+BLOCK_HEADER_MAX_SIZE+20){
+                result = -1;
+                break;
+            }
+            if(frame_size > job->block_capacity){
+                job->block_capacity = frame_size;
+                job->data.block = (unsigned char*)realloc(job->data.block,frame_size);
+            }
+            if(raw_size > job->raw_capacity){
+                job->raw_capacity = raw_size;
+                job->data.raw = (unsigned char*)realloc(job->data.raw,raw_size);
+            }
+            job->block_number = next;
+            TP_submit(pool,decompress_frame_job,job);
+        }
+        TP_wait(pool);
+        for(i=0;i<(size_t)num_jobs && result == 0;i++){
+            if(jobs[i].data.result < 0) result = -1;
+            else if(fwrite(jobs[i].data.raw,1,jobs[i].data.raw_size,output) != jobs[i].data.raw_size) result = -1;
+        }
+    }
+    TP_destroy(pool);
+    for(i=0;i<(size_t)batch_size;i++){
+        free(jobs[i].data.raw);
+        free(jobs[i].data.block);
+    }
+    free(jobs);
+    free(decoding.index);
+    if(result == 0 && fflush(output) != 0) result = -1;
+    return result;
+}
+
+/* END OF PARALLEL COMPRESSION */
+
+
+/* IN-MEMORY COMPRESSION AND MEMORY-MAPPED FILES */
+
+/* The string functions (encode, encode_canonical, ...) stop at the first '\0', so they cannot compress binary data, and
+they scan the input with strlen. The functions below take a pointer and a size instead, and produce (or read) the same
+framed format as the files, so both can be used together.
+
+To compress or decompress a file without reading it (that is, without copying it from the kernel to a buffer), we map
+the file in memory with mmap: the file itself becomes the input buffer. The compression feeds the whole mapped input 
+to the stream, which encodes the blocks where they are (see HS_compress_feed) and writes each frame with a single 
+fwrite. The decompression first reads the sizes of the frames, to know the size of the output; then the output file is
+created with this size and also mapped, so that each block is decoded directly in its place in the output file. */
+
+/* Reads the sizes of the frame at position pos. Returns the position of the block, or -1 if the frame is not valid. 
+A raw size of 0 is the end of the frames. */
+
+long next_frame(const unsigned char *input, size_t size, size_t pos, uint64_t *raw_size, uint64_t *block_size){
+    int varint = read_varint(input+pos,size-pos,raw_size);
+    if(varint < 0) return -1;
+    pos += varint;
+    if(*raw_size == 0) return pos;
+    if(*raw_size > HS_MAX_BLOCK_SIZE) return -1;
+    varint = read_varint(input+pos,size-pos,block_size);
+    if(varint < 0) return -1;
+    pos += varint;
+    if(*block_size > 2*(*raw_size)+BLOCK_HEADER_MAX_SIZE || *block_size > size-pos) return -1;
+    return pos;
+}
+
+/* Gives the total size of the original data in *raw_size. Returns 0, or -1 if the input is not valid. */
+
+int frames_raw_size(const unsigned char *input, size_t size, uint64_t *raw_size){
+    uint64_t frame_raw_size, block_size;
+    long pos = 4;
+    *raw_size = 0;
+    if(size < 4 || memcmp(input,HS_MAGIC,4) != 0) return -1;
+    while((pos = next_frame(input,size,pos,&frame_raw_size,&block_size)) >= 0){
+        if(frame_raw_size == 0) return 0;
+        *raw_size += frame_raw_size;
+        pos += block_size;
+    }
+    return -1;
+}
+
+/* Decodes all the frames into the output, which has room for raw_size bytes (as given by frames_raw_size). Returns 0
+on success or -1 if the input is not valid. */
+
+int decode_frames(const unsigned char *input, size_t size, uint8_t *output, uint64_t raw_size){
+    uint64_t frame_raw_size, block_size, done = 0;
+    long pos = 4;
+    if(size < 4 || memcmp(input,HS_MAGIC,4) != 0) return -1;
+    while((pos = next_frame(input,size,pos,&frame_raw_size,&block_size)) >= 0){
+        if(frame_raw_size == 0) return done == raw_size ? 0 : -1;
+        if(frame_raw_size > raw_size-done) return -1;
+        if(decode_block(input+pos,block_size,output+done,frame_raw_size) < 0) return -1;
+        done += frame_raw_size;
+        pos += block_size;
+    }
+    return -1;
+}
+
+/* Compresses the input in memory and gives the size of the output in *output_size. Returns NULL on failure. The output
+must be freed by the caller. */
+
+unsigned char *compress_memory(const uint8_t *input, size_t size, size_t block_size, int max_code_length, int model_order, size_t *output_size){
+    char *output = NULL;
+    FILE *memory = open_memstream(&output,output_size);
+    if(!memory) return NULL;
+    HS *stream = HS_compress_init(memory,block_size,max_code_length,model_order);
+    int result = stream ? HS_compress_feed(stream,input,size) : -1;
+    if(stream && HS_compress_finish(stream) < 0) result = -1;
+    if(fclose(memory) != 0) result = -1;
+    if(result < 0){
+        free(output);
+        return NULL;
+    }
+    return (unsigned char*)output;
+}
+
+/* Decompresses the input in memory and gives the size of the output in *output_size. Returns NULL if the input is not 
+valid. The output must be freed by the caller. */
+
+uint8_t *decompress_memory(const unsigned char *input, size_t size, size_t *output_size){
+    uint64_t raw_size;
+    if(frames_raw_size(input,size,&raw_size) < 0 || raw_size != (size_t)raw_size) return NULL;
+    uint8_t *output = (uint8_t*)malloc(raw_size ? raw_size : 1);
+    if(!output || decode_frames(input,size,output,raw_size) < 0){
+        free(output);
+        return NULL;
+    }
+    *output_size = raw_size;
+    return output;
+}
+
+/* Maps a whole file for reading. An empty file gives *data = NULL and *size = 0. Returns 0 or -1. */
+
+int map_file(const char *name, const unsigned char **data, size_t *size){
+    struct stat status;
+    int fd = open(name,O_RDONLY);
+    if(fd < 0) return -1;
+    if(fstat(fd,&status) < 0 || !S_ISREG(status.st_mode)){
+        close(fd);
+        return -1;
+    }
+    *size = status.st_size;
+    *data = NULL;
+    if(*size > 0){
+        void *map = mmap(NULL,*size,PROT_READ,MAP_PRIVATE,fd,0);
+        if(map == MAP_FAILED){
+            close(fd);
+            return -1;
+        }
+        madvise(map,*size,MADV_SEQUENTIAL);
+        *data = (const unsigned char*)map;
+    }
+    close(fd);
+    return 0;
+}
+
+void unmap_file(const unsigned char *data, size_t size){
+    if(size > 0) munmap((void*)data,size);
+}
+
+int compress_mapped_file(const char *input_name, FILE *output, size_t block_size, int max_code_length, int model_order){
+    const unsigned char *data;
+    size_t size;
+    if(map_file(input_name,&data,&size) < 0) return -1;
+    HS *stream = HS_compress_init(output,block_size,max_code_length,model_order);
+    int result = stream ? HS_compress_feed(stream,data,size) : -1;
+    if(stream && HS_compress_finish(stream) < 0) result = -1;
+    unmap_file(data,size);
+    return result;
+}
+
+/* The output must be a regular file (or NULL for the standard output, which cannot be mapped: then the data is 
+decompressed in memory and written at once). */
+
+int decompress_mapped_file(const char *input_name, const char *output_name){
+    const unsigned char *data;
+    size_t size;
+    uint64_t raw_size;
+    int result = -1;
+    if(map_file(input_name,&data,&size) < 0) return -1;
+    if(frames_raw_size(data,size,&raw_size) < 0 || raw_size != (size_t)raw_size){
+        unmap_file(data,size);
+        return -1;
+    }
+    if(!output_name){
+        size_t output_size;
+        uint8_t *output = decompress_memory(data,size,&output_size);
+        if(output && fwrite(output,1,output_size,stdout) == output_size && fflush(stdout) == 0) result = 0;
+        free(output);
+        unmap_file(data,size);
+        return result;
+    }
+    int fd = open(output_name,O_RDWR | O_CREAT | O_TRUNC,0644);
+    if(fd >= 0 && ftruncate(fd,raw_size) == 0){
+        if(raw_size == 0) result = decode_frames(data,size,NULL,0);
+        else{
+            void *map = mmap(NULL,raw_size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+            if(map != MAP_FAILED){
+                result = decode_frames(data,size,(uint8_t*)map,raw_size);
+                if(munmap(map,raw_size) != 0) result = -1;
+            }
+        }
+    }
+    if(fd >= 0 && close(fd) != 0) result = -1;
+    unmap_file(data,size);
+    return result;
+}
+
+/* END OF IN-MEMORY COMPRESSION AND MEMORY-MAPPED FILES */
+
+
+/* ADAPTIVE HUFFMAN CODING */
+
+/* All the functions above need the whole input (or a whole block) before encoding, since they have to count the 
+frequencies first. This is impossible for live streams. In "adaptive" (or "dynamic") Huffman coding, the encoder and 
+the decoder both start with the same trivial tree and update it after each symbol, in exactly the same way. Hence the 
+tree is always the Huffman tree of the symbols seen so far, there is no header, and both sides work in a single pass 
+with constant memory. We implement the FGK algorithm (Faller, Gallager and Knuth), as described in Sayood's book.
+
+The tree has a special leaf, NYT ("not yet transmitted"), with weight 0. A symbol that was never seen is encoded as the
+code of NYT followed by the symbol itself in ADAPTIVE_LITERAL_BITS bits. The alphabet has the 256 bytes and an extra 
+symbol, ADAPTIVE_EOS, which marks the end of the stream.
+
+The nodes are numbered so that the weights never decrease with the number and a parent always has a larger number 
+than its children (the "sibling property"); a tree with this property is a Huffman tree. Here the number of a node is 
+its position in the array of nodes: the root is the last node, and NYT is always the first used node. To update the 
+tree after a symbol, we start at its leaf and go up to the root. At each node, we first swap it (with its subtree) with 
+the node of largest number having the same weight (the "leader" of its "block"), unless this node is its parent. Then
+we increment its weight. A new symbol first turns NYT into an internal node with two children: a new NYT and the leaf
+of the symbol.
+
+The weights grow without limit, so when the weight of the root reaches ADAPTIVE_MAX_WEIGHT both sides start again 
+with a new tree. */
+
+#define ADAPTIVE_ALPHABET 257
+#define ADAPTIVE_EOS 256
+#define ADAPTIVE_LITERAL_BITS 9
+#define ADAPTIVE_MAX_NODES (2*(ADAPTIVE_ALPHABET+1)-1)
+#define ADAPTIVE_ROOT (ADAPTIVE_MAX_NODES-1)
+#define ADAPTIVE_MAX_WEIGHT (1u << 30)
+#define ADAPTIVE_NYT -1 /* "symbol" of the NYT leaf */
+#define ADAPTIVE_INTERNAL -2 /* "symbol" of the internal nodes */
+
+typedef struct adaptive_node{
+    unsigned int weight;
+    int parent, left, right; /* positions in the array of nodes (-1 if there is none) */
+    int symbol;
+}ANode;
+
+typedef struct adaptive_huffman{
+    ANode nodes[ADAPTIVE_MAX_NODES];
+    int leaf_of[ADAPTIVE_ALPHABET]; /* position of the leaf of each symbol (-1 if there is none) */
+    int nyt;
+}AH; /* AH stands for Adaptive Huffman */
+
+void AH_initialize(AH *model){
+    int i;
+    for(i=0;i<ADAPTIVE_ALPHABET;i++) model->leaf_of[i] = -1;
+    model->nyt = ADAPTIVE_ROOT;
+    model->nodes[ADAPTIVE_ROOT].weight = 0;
+    model->nodes[ADAPTIVE_ROOT].parent = -1;
+    model->nodes[ADAPTIVE_ROOT].left = -1;
+    model->nodes[ADAPTIVE_ROOT].right = -1;
+    model->nodes[ADAPTIVE_ROOT].symbol = ADAPTIVE_NYT;
+}
+
+/* After a node changes its position, whoever points to it must be told. */
+
+void AH_fix_links(AH *model, int i){
+    ANode *node = &model->nodes[i];
+    if(node->symbol == ADAPTIVE_INTERNAL){
+        model->nodes[node->left].parent = i;
+        model->nodes[node->right].parent = i;
+    }
+    else if(node->symbol == ADAPTIVE_NYT) model->nyt = i;
+    else model->leaf_of[node->symbol] = i;
+}
+
+/* Swaps the subtrees at positions a and b. The parents stay where they are. */
+
+void AH_swap(AH *model, int a, int b){
+    ANode aux = model->nodes[a];
+    int parent_a = model->nodes[a].parent, parent_b = model->nodes[b].parent;
+    ANode *node_a = &model->nodes[a], *node_b = &model->nodes[b];
+    *node_a = *node_b;
+    *node_b = aux;
+    node_a->parent = parent_a;
+    node_b->parent = parent_b;
+    AH_fix_links(model,a);
+    AH_fix_links(model,b);
+}
+
+int AH_block_leader(AH *model, int i){
+    unsigned int weight = model->nodes[i].weight;
+    while(i < ADAPTIVE_ROOT && model->nodes[i+1].weight == weight) i++;
+    return i;
+}
+
+void AH_update(AH *model, int symbol){
+    ANode *nodes = model->nodes;
+    int q = model->leaf_of[symbol];
+    if(q < 0){
+        int old_nyt = model->nyt, leaf = old_nyt-1, new_nyt = old_nyt-2;
+        nodes[leaf].weight = 1;
+        nodes[leaf].parent = old_nyt;
+        nodes[leaf].left = nodes[leaf].right = -1;
+        nodes[leaf].symbol = symbol;
+        nodes[new_nyt].weight = 0;
+        nodes[new_nyt].parent = old_nyt;
+        nodes[new_nyt].left = nodes[new_nyt].right = -1;
+        nodes[new_nyt].symbol = ADAPTIVE_NYT;
+        nodes[old_nyt].weight = 1;
+        nodes[old_nyt].left = new_nyt;
+        nodes[old_nyt].right = leaf;
+        nodes[old_nyt].symbol = ADAPTIVE_INTERNAL;
+        model->leaf_of[symbol] = leaf;
+        model->nyt = new_nyt;
+        q = nodes[old_nyt].parent;
+    }
+    while(q >= 0){
+        int leader = AH_block_leader(model,q);
+        if(leader != q && leader != nodes[q].parent){
+            AH_swap(model,q,leader);
+            q = leader;
+        }
+        nodes[q].weight++;
+        q = nodes[q].parent;
+    }
+    if(nodes[ADAPTIVE_ROOT].weight >= ADAPTIVE_MAX_WEIGHT) AH_initialize(model);
+}
+
+/* The code of a node is the path from the root to it, so we collect the bits from the node up to the root. The depth 
+of the tree is less than 64, because of ADAPTIVE_MAX_WEIGHT. */
+
+void AH_put_code(AH *model, int i, BW *writer){
+    uint64_t code = 0;
+    int length = 0;
+    while(i != ADAPTIVE_ROOT){
+        int parent = model->nodes[i].parent;
+        if(model->nodes[parent].right == i) code |= (uint64_t)1 << length;
+        length++;
+        i = parent;
+    }
+    if(length > 0) BW_put_bits(writer,code,length);
+}
+
+void AH_encode_symbol(AH *model, int symbol, BW *writer){
+    if(model->leaf_of[symbol] >= 0) AH_put_code(model,model->leaf_of[symbol],writer);
+    else{
+        AH_put_code(model,model->nyt,writer);
+        BW_put_bits(writer,symbol,ADAPTIVE_LITERAL_BITS);
+    }
+    AH_update(model,symbol);
+}
+
+/* Returns the decoded symbol, or -1 if the stream is not valid. */
+
+int AH_decode_symbol(AH *model, BR *reader){
+    int i = ADAPTIVE_ROOT, symbol;
+    while(model->nodes[i].symbol == ADAPTIVE_INTERNAL){
+        if(BR_get_bit(reader)) i = model->nodes[i].right;
+        else i = model->nodes[i].left;
+    }
+    symbol = model->nodes[i].symbol;
+    if(symbol == ADAPTIVE_NYT){
+        symbol = (int)BR_peek_bits(reader,ADAPTIVE_LITERAL_BITS);
+        BR_consume_bits(reader,ADAPTIVE_LITERAL_BITS);
+        if(symbol >= ADAPTIVE_ALPHABET || model->leaf_of[symbol] >= 0) return -1;
+    }
+    if(BR_past_end(reader)) return -1;
+    AH_update(model,symbol);
+    return symbol;
+}
+
+/* Encodes a whole buffer, followed by ADAPTIVE_EOS, and gives the number of bytes written. */
+
+unsigned char *adaptive_encode(const unsigned char *input, size_t size, size_t *output_size){
+    AH *model = (AH*)malloc(sizeof(AH));
+    BW writer;
+    size_t i;
+    AH_initialize(model);
+    BW_initialize(&writer,size/2);
+    for(i=0;i<size;i++) AH_encode_symbol(model,input[i],&writer);
+    AH_encode_symbol(model,ADAPTIVE_EOS,&writer);
+    BW_flush(&writer);
+    free(model);
+    *output_size = writer.byte_pos;
+    return writer.buffer;
+}
+
+/* Decodes into the output, which has room for max_size bytes. Returns the number of bytes decoded, or -1 if the input
+is not valid (or if the output is too small). */
+
+long adaptive_decode(const unsigned char *input, size_t size, unsigned char *output, size_t max_size){
+    AH *model = (AH*)malloc(sizeof(AH));
+    BR reader;
+    long j = 0;
+    int symbol;
+    AH_initialize(model);
+    BR_initialize(&reader,input,size);
+    while((symbol = AH_decode_symbol(model,&reader)) >= 0 && symbol != ADAPTIVE_EOS){
+        if((size_t)j == max_size) break;
+        output[j++] = symbol;
+    }
+    free(model);
+    if(symbol != ADAPTIVE_EOS) return -1;
+    return j;
+}
+
+/* The file versions work on chunks, so they may be used on pipes of unknown length. Both return 0 on success or -1 on
+failure. */
+
+int adaptive_compress_file(FILE *input, FILE *output){
+    unsigned char chunk[FILE_CHUNK_SIZE];
+    AH *model = (AH*)malloc(sizeof(AH));
+    BW writer;
+    size_t size, i;
+    int result = 0;
+    AH_initialize(model);
+    BW_initialize(&writer,2*FILE_CHUNK_SIZE);
+    while(result == 0 && (size = fread(chunk,1,FILE_CHUNK_SIZE,input)) > 0){
+        for(i=0;i<size;i++) AH_encode_symbol(model,chunk[i],&writer);
+        result = BW_drain(&writer,output);
+    }
+    if(ferror(input)) result = -1;
+    AH_encode_symbol(model,ADAPTIVE_EOS,&writer);
+    BW_flush(&writer);
+    if(result == 0) result = BW_drain(&writer,output);
+    if(result == 0 && fflush(output) != 0) result = -1;
+    free(writer.buffer);
+    free(model);
+    return result;
+}
+
+int adaptive_decompress_file(FILE *input, FILE *output){
+    unsigned char chunk[FILE_CHUNK_SIZE];
+    AH *model = (AH*)malloc(sizeof(AH));
+    BR reader;
+    size_t j = 0;
+    int symbol, result = 0;
+    AH_initialize(model);
+    BR_initialize_file(&reader,input);
+    while((symbol = AH_decode_symbol(model,&reader)) >= 0 && symbol != ADAPTIVE_EOS){
+        chunk[j++] = symbol;
+        if(j == FILE_CHUNK_SIZE){
+            if(fwrite(chunk,1,j,output) != j) break;
+            j = 0;
+        }
+    }
+    if(symbol != ADAPTIVE_EOS || fwrite(chunk,1,j,output) != j || fflush(output) != 0) result = -1;
+    free(reader.chunk);
+    free(model);
+    return result;
+}
+
+/* To compare the adaptive mode with the static (two-pass) mode, we compress the same data in memory with both and 
+print the compression factor and the speed of the encoder and of the decoder (in MB/s). The static mode uses blocks of
+HS_DEFAULT_BLOCK_SIZE bytes. */
+
+double seconds_now(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+void benchmark_adaptive(const unsigned char *data, size_t size){
+    unsigned char *decoded = (unsigned char*)malloc(size+1);
+    size_t static_size = 0, adaptive_size, pos;
+    double start, static_encode, static_decode, adaptive_encode_time, adaptive_decode_time;
+    double megabytes = size/1e6;
+    int ok = 1;
+    BW writer;
+
+    /* static: we keep the blocks in a single buffer */
+    unsigned char *blocks = (unsigned char*)malloc(size+(size/HS_DEFAULT_BLOCK_SIZE+1)*BLOCK_HEADER_MAX_SIZE);
+    size_t *block_sizes = (size_t*)malloc((size/HS_DEFAULT_BLOCK_SIZE+1)*sizeof(size_t));
+    BW_initialize(&writer,HS_DEFAULT_BLOCK_SIZE+BLOCK_HEADER_MAX_SIZE);
+    start = seconds_now();
+    for(pos=0;pos<size;pos+=HS_DEFAULT_BLOCK_SIZE){
+        size_t raw_size = size-pos < HS_DEFAULT_BLOCK_SIZE ? size-pos : HS_DEFAULT_BLOCK_SIZE;
+        size_t block_size = encode_block(data+pos,raw_size,DEFAULT_MAX_CODE_LENGTH,&writer);
+        memcpy(blocks+static_size,writer.buffer,block_size);
+        block_sizes[pos/HS_DEFAULT_BLOCK_SIZE] = block_size;
+        static_size += block_size;
+    }
+    static_encode = seconds_now()-start;
+    start = seconds_now();
+    size_t block_pos = 0;
+    for(pos=0;pos<size;pos+=HS_DEFAULT_BLOCK_SIZE){
+        size_t raw_size = size-pos < HS_DEFAULT_BLOCK_SIZE ? size-pos : HS_DEFAULT_BLOCK_SIZE;
+        if(decode_block(blocks+block_pos,block_sizes[pos/HS_DEFAULT_BLOCK_SIZE],decoded+pos,raw_size) < 0) ok = 0;
+        block_pos += block_sizes[pos/HS_DEFAULT_BLOCK_SIZE];
+    }
+    static_decode = seconds_now()-start;
+    if(memcmp(decoded,data,size) != 0) ok = 0;
+    free(writer.buffer);
+    free(blocks);
+    free(block_sizes);
+
+    start = seconds_now();
+    unsigned char *adaptive = adaptive_encode(data,size,&adaptive_size);
+    adaptive_encode_time = seconds_now()-start;
+    start = seconds_now();
+    if(adaptive_decode(adaptive,adaptive_size,decoded,size) != (long)size || memcmp(decoded,data,size) != 0) ok = 0;
+    adaptive_decode_time = seconds_now()-start;
+    free(adaptive);
+    free(decoded);
+
+    printf("mode      factor    encode MB/s  decode MB/s\n");
+    printf("static    %f  %11.1f  %11.1f\n",size ? (float)static_size/size : 0,megabytes/static_encode,megabytes/static_decode);
+    printf("adaptive  %f  %11.1f  %11.1f\n",size ? (float)adaptive_size/size : 0,megabytes/adaptive_encode_time,megabytes/adaptive_decode_time);
+    if(!ok) printf("ERROR: the decoded data differs from the input\n");
+}
+
+/* END OF ADAPTIVE HUFFMAN CODING */
+
+
+/* BENCHMARK */
+
+/* To know whether a change makes the program faster (or compress better), we need to measure it, always in the same 
+way. The benchmark compresses and decompresses each input of a "corpus" in memory, block by block (as the streaming 
+compression does), and measures each stage separately:
+
+histogram   counting the frequencies (count_frequencies)
+tree        computing the code lengths (build_code_lengths)
+encode      assigning the canonical codes and writing the block
+table       reading the header and building the decoding table
+decode      decoding the packed code (decode_symbols)
+decode_x4   decoding the same block written as 4 interleaved streams (see INTERLEAVED STREAMS), with the same table
+
+Each input is processed "repetitions" times, and we keep the fastest time of each stage (the slower runs were disturbed
+by something else). The inputs are files, or data generated with a fixed seed (so that they are the same in every run):
+
+gen:uniform   random bytes
+gen:zipf      bytes with the Zipf distribution (the k-th most frequent byte has frequency proportional to 1/k)
+gen:text      words (of a vocabulary with Zipf frequencies) separated by spaces and line breaks
+
+The output is CSV, with one line for each input and stage, so that the results can be kept and compared over time:
+
+corpus,bytes,compressed_bytes,ratio,stage,mb_per_s,cycles_per_byte,peak_rss_kb
+
+The cycles are read from the time stamp counter of x86 processors (0 elsewhere), and the peak RSS is the maximum 
+memory used by the process so far. */
+
+#define BENCHMARK_DEFAULT_SIZE (16 << 20)
+#define BENCHMARK_STAGES 6
+
+const char *benchmark_stage_names[BENCHMARK_STAGES] = {"histogram","tree","encode","table","decode","decode_x4"};
+
+typedef struct stage_time{
+    double seconds;
+    uint64_t cycles;
+}ST; /* ST stands for Stage Time */
+
+uint64_t read_cycles(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+void ST_start(ST *time){
+    time->seconds -= seconds_now();
+    time->cycles -= read_cycles();
+}
+
+void ST_stop(ST *time){
+    time->seconds += seconds_now();
+    time->cycles += read_cycles();
+}
+
+/* Reads a whole file in memory (the buffer grows as needed). Returns NULL if the file cannot be read. */
+
+unsigned char *read_whole_file(FILE *input, size_t *size){
+    size_t capacity = FILE_CHUNK_SIZE, read;
+    unsigned char *data = (unsigned char*)malloc(capacity);
+    *size = 0;
+    while((read = fread(data+*size,1,capacity-*size,input)) > 0){
+        *size += read;
+        if(*size == capacity) data = (unsigned char*)realloc(data,capacity *= 2);
+    }
+    if(ferror(input)){
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+/* A small and fast pseudo-random generator (xorshift64*). The state must not be 0. */
+
+uint64_t next_random(uint64_t *state){
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Fills cumulative[0..n-1] with the cumulative Zipf distribution, and picks from it with a binary search. */
+
+void zipf_cumulative(double *cumulative, int n){
+    double total = 0;
+    int k;
+    for(k=0;k<n;k++){
+        total += 1.0/(k+1);
+        cumulative[k] = total;
+    }
+    for(k=0;k<n;k++) cumulative[k] /= total;
+}
+
+int zipf_pick(double *cumulative, int n, uint64_t *state){
+    double x = (next_random(state) >> 11) * (1.0/9007199254740992.0);
+    int low = 0, high = n-1;
+    while(low < high){
+        int middle = (low+high)/2;
+        if(cumulative[middle] < x) low = middle+1;
+        else high = middle;
+    }
+    return low;
+}
+
+#define BENCHMARK_VOCABULARY 1024
+
+/* Returns NULL if the name is not a known distribution. */
+
+unsigned char *generate_corpus(const char *name, size_t size){
+    unsigned char *data = (unsigned char*)malloc(size ? size : 1);
+    double cumulative[BENCHMARK_VOCABULARY];
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    size_t i;
+    if(strcmp(name,"gen:uniform") == 0){
+        for(i=0;i<size;i++) data[i] = next_random(&state) >> 56;
+    }
+    else if(strcmp(name,"gen:zipf") == 0){
+        zipf_cumulative(cumulative,256);
+        for(i=0;i<size;i++) data[i] = zipf_pick(cumulative,256,&state);
+    }
+    else if(strcmp(name,"gen:text") == 0){
+        char words[BENCHMARK_VOCABULARY][12];
+        int k, j, words_in_line = 0;
+        for(k=0;k<BENCHMARK_VOCABULARY;k++){
+            int length = 1 + next_random(&state) % 10;
+            for(j=0;j<length;j++) words[k][j] = 'a' + next_random(&state) % 26;
+            words[k][length] = '\0';
+        }
+        zipf_cumulative(cumulative,BENCHMARK_VOCABULARY);
+        i = 0;
+        while(i < size){
+            const char *word = words[zipf_pick(cumulative,BENCHMARK_VOCABULARY,&state)];
+            while(*word && i < size) data[i++] = *word++;
+            if(i < size) data[i++] = ++words_in_line % 12 == 0 ? '\n' : ' ';
+        }
+    }
+    else{
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+/* Runs all the stages on the data and adds their times. Returns the compressed size, or 0 if the data was not decoded 
+correctly. */
+
+size_t benchmark_stages(const unsigned char *data, size_t size, size_t block_size, int max_code_length, ST *times){
+    unsigned char *decoded = (unsigned char*)malloc(block_size);
+    unsigned int freq[256];
+    unsigned char lengths[256];
+    Code codes[256];
+    size_t pos, compressed = 0;
+    BW writer, interleaved;
+    BW_initialize(&writer,block_size+BLOCK_HEADER_MAX_SIZE);
+    BW_initialize(&interleaved,block_size+BLOCK_HEADER_MAX_SIZE);
+    for(pos=0;pos<size;pos+=block_size){
+        size_t raw_size = size-pos < block_size ? size-pos : block_size;
+        uint64_t bit_length;
+        int header_size;
+
+        ST_start(&times[0]);
+        count_frequencies(data+pos,raw_size,freq);
+        ST_stop(&times[0]);
+
+        ST_start(&times[1]);
+        build_code_lengths(freq,max_code_length,lengths);
+        ST_stop(&times[1]);
+
+        ST_start(&times[2]);
+        assign_canonical_codes(lengths,codes);
+        bit_length = code_bit_length(freq,lengths);
+        BW_reset(&writer);
+        BW_reserve(&writer,BLOCK_HEADER_MAX_SIZE+(bit_length+7)/8);
+        writer.byte_pos = write_code_lengths_header(lengths,writer.buffer);
+        writer.byte_pos += write_varint(bit_length,writer.buffer+writer.byte_pos);
+        BW_put_codes(&writer,data+pos,raw_size,codes);
+        BW_flush(&writer);
+        ST_stop(&times[2]);
+        compressed += writer.byte_pos;
+
+        ST_start(&times[3]);
+        header_size = read_block_header(writer.buffer,writer.byte_pos,lengths,&bit_length);
+        assign_canonical_codes(lengths,codes);
+        DT *table = header_size < 0 ? NULL : build_decode_table(codes);
+        ST_stop(&times[3]);
+        if(!table) break;
+
+        ST_start(&times[4]);
+        long decoded_size = decode_symbols(writer.buffer+header_size,bit_length,table,decoded,raw_size);
+        ST_stop(&times[4]);
+        if(decoded_size != (long)raw_size || memcmp(decoded,data+pos,raw_size) != 0){
+            DT_free(table);
+            break;
+        }
+
+        uint64_t bit_lengths[INTERLEAVED_STREAMS];
+        const unsigned char *streams[INTERLEAVED_STREAMS];
+        size_t interleaved_size = encode_interleaved_block(data+pos,raw_size,max_code_length,&interleaved);
+        read_interleaved_header(interleaved.buffer,interleaved_size,lengths,bit_lengths,streams);
+        ST_start(&times[5]);
+        int result = decode_interleaved_symbols(streams,bit_lengths,table,decoded,raw_size);
+        ST_stop(&times[5]);
+        DT_free(table);
+        if(result < 0 || memcmp(decoded,data+pos,raw_size) != 0) break;
+    }
+    free(writer.buffer);
+    free(interleaved.buffer);
+    free(decoded);
+    if(pos < size) return 0;
+    return compressed;
+}
+
+/* Besides the round trips, the decoders must reject corrupt blocks (without crashing). Here the codes of the blocks 
+are incomplete (a = 0 and b = 10, or a = 0 alone) and the streams only contain bits 1, which do not start any code. 
+Returns 0 if both blocks are rejected, or -1 otherwise. */
+
+int check_corrupt_blocks(){
+    unsigned char block[2+5+INTERLEAVED_STREAMS+INTERLEAVED_STREAMS*8], decoded[64];
+    const unsigned char two_symbols[] = {1,2,1,'a','b'}, one_symbol[] = {0,1,'a'};
+    const unsigned char *headers[2] = {two_symbols,one_symbol};
+    size_t header_sizes[2] = {sizeof(two_symbols),sizeof(one_symbol)};
+    int k, s;
+    for(k=0;k<2;k++){
+        size_t pos = 0;
+        block[pos++] = INTERLEAVED_BLOCK;
+        block[pos++] = 0;
+        memcpy(block+pos,headers[k],header_sizes[k]);
+        pos += header_sizes[k];
+        for(s=0;s<INTERLEAVED_STREAMS;s++) pos += write_varint(64,block+pos);
+        memset(block+pos,0xFF,INTERLEAVED_STREAMS*8);
+        pos += INTERLEAVED_STREAMS*8;
+        if(decode_interleaved_block(block,pos,decoded,sizeof(decoded)) == 0) return -1;
+    }
+    return 0;
+}
+
+/* Returns 0 on success, or -1 if some input cannot be read or is not decoded correctly. */
+
+int run_benchmark(char **corpus, int corpus_size, size_t generated_size, size_t block_size, int max_code_length, int repetitions){
+    int i, r, k, result = 0;
+    if(check_corrupt_blocks() < 0){
+        fprintf(stderr,"a corrupt block was not rejected\n");
+        result = -1;
+    }
+    printf("corpus,bytes,compressed_bytes,ratio,stage,mb_per_s,cycles_per_byte,peak_rss_kb\n");
+    for(i=0;i<corpus_size;i++){
+        unsigned char *data;
+        size_t size = generated_size, compressed = 0;
+        ST best[BENCHMARK_STAGES];
+        if(strncmp(corpus[i],"gen:",4) == 0) data = generate_corpus(corpus[i],size);
+        else{
+            FILE *input = fopen(corpus[i],"rb");
+            data = input ? read_whole_file(input,&size) : NULL;
+            if(input) fclose(input);
+        }
+        if(!data){
+            fprintf(stderr,"cannot read %s\n",corpus[i]);
+            result = -1;
+            continue;
+        }
+        for(r=0;r<repetitions;r++){
+            ST times[BENCHMARK_STAGES];
+            memset(times,0,sizeof(times));
+            compressed = benchmark_stages(data,size,block_size,max_code_length,times);
+            for(k=0;k<BENCHMARK_STAGES;k++){
+                if(r == 0 || times[k].seconds < best[k].seconds) best[k] = times[k];
+            }
+        }
+        free(data);
+        if(size > 0 && compressed == 0){
+            fprintf(stderr,"%s was not decoded correctly\n",corpus[i]);
+            result = -1;
+            continue;
+        }
+        struct rusage usage;
+        getrusage(RUSAGE_SELF,&usage);
+        for(k=0;k<BENCHMARK_STAGES;k++){
+            printf("%s,%zu,%zu,%.4f,%s,%.1f,%.3f,%ld\n",corpus[i],size,compressed,size ? (double)compressed/size : 0,
+                benchmark_stage_names[k],best[k].seconds > 0 ? size/1e6/best[k].seconds : 0,
+                size ? (double)best[k].cycles/size : 0,usage.ru_maxrss);
+        }
+    }
+    return result;
+}
+
+/* END OF BENCHMARK */
+
+
+ /* COMPUTING THE COMPRESSION FACTOR */
+
+ /* The compression factor is the ratio between the respective bit sizes of the original string and of its
+ Huffman code. */
+
+float compression_factor(char *input_string, char *encoded_string){
+    int input_size = 8*strlen(input_string);
+    int code_size = strlen(encoded_string);
+    float result = (float)code_size / (float) input_size;
+    return result;
+}
+
+/* In packed mode, the size of the code is just its bit length. */
+
+float packed_compression_factor(char *input_string, size_t bit_length){
+    float result = (float)bit_length / (float)(8*strlen(input_string));
+    return result;
+}
+
+ /* END OF COMPUTING THE COMPRESSION FACTOR */
+
+
+/* PRINTING FUNCTIONS (FOR TESTS)*/
+
+void print_coding_tree(Tree *t, int i){
+    if(i != NO_NODE){
+        if(t->nodes[i].is_leaf){
+            printf("(%c)", t->nodes[i].character);
+        }
+        else{
+            printf("(%d",t->nodes[i].freq);
+            print_coding_tree(t,t->nodes[i].left);
+            print_coding_tree(t,t->nodes[i].right);
+            printf(")");
+        }
+    }
+}
+
+void print_priority_queue(PQ *q){
+    int i;
+    for(i=0;i<q->size;i++){
+        printf("%c,%d--",q->tree->nodes[q->queue[i]].character,PQ_freq(q,i));
+    }
+}
+
+void print_linked_list(Tree *t, LL *l){
+    if(l){
+        printf("%c,%d--",t->nodes[l->tree_node].character,l->tree_node);
+        print_linked_list(t,l->next);
+    }
+}
+
+void print_map(Map *map){
+    int i;
+    for(i=0;i<256;i++){
+        if(map->map[i]) printf("%c,%s--", map->map[i]->character, map->map[i]->code);
+    }
+}
+/* END OF PRINTING FUNCTIONS */
+
+
+/* COMMAND LINE */
+
+/* Besides the interactive test in the main function, the program compresses and decompresses files:
+
+HuffmanCoding -c input output [-b block size] [-l maximum code length] [-m model order] [-t number of threads]
+HuffmanCoding -d input output [-t number of threads]
+HuffmanCoding -mc input output [-b block size] [-l maximum code length] [-m model order]
+HuffmanCoding -md input output
+HuffmanCoding -ac input output
+HuffmanCoding -ad input output
+HuffmanCoding -ab input
+HuffmanCoding -bench [-r repetitions] [-n generated size] [-b block size] [-l maximum code length] corpus...
+
+The file names may be "-", meaning the standard input or output. With more than one thread, the blocks are compressed
+(or decompressed) in parallel. The parallel decompression needs a regular input file; otherwise, the input is 
+decompressed sequentially. The model order is 0 (the default) or 1 (see CONTEXT MODELLING). The options -mc and -md
+do the same with memory-mapped files (the input must be a regular file). The options -ac and -ad 
+use the adaptive mode, and -ab compares the adaptive and the static modes on the given file. The option -bench runs 
+the benchmark (see BENCHMARK) on the given files or generated inputs. */
+
+FILE *open_file(char *name, char *mode){
+    if(strcmp(name,"-") == 0) return mode[0] == 'r' ? stdin : stdout;
+    return fopen(name,mode);
+}
+
+int run_adaptive_command_line(int argc, char *argv[]){
+    int compress = strcmp(argv[1],"-ac") == 0, benchmark = strcmp(argv[1],"-ab") == 0, result;
+    if(argc != (benchmark ? 3 : 4)){
+        fprintf(stderr,"usage: %s -ac input output | -ad input output | -ab input\n",argv[0]);
+        return 1;
+    }
+    FILE *input = open_file(argv[2],"rb");
+    if(!input){
+        fprintf(stderr,"cannot open %s\n",argv[2]);
+        return 1;
+    }
+    if(benchmark){
+        size_t size;
+        unsigned char *data = read_whole_file(input,&size);
+        if(input != stdin) fclose(input);
+        if(!data){
+            fprintf(stderr,"cannot read %s\n",argv[2]);
+            return 1;
+        }
+        benchmark_adaptive(data,size);
+        free(data);
+        return 0;
+    }
+    FILE *output = open_file(argv[3],"wb");
+    if(!output){
+        fprintf(stderr,"cannot open %s\n",argv[3]);
+        return 1;
+    }
+    result = compress ? adaptive_compress_file(input,output) : adaptive_decompress_file(input,output);
+    if(input != stdin) fclose(input);
+    if(output != stdout && fclose(output) != 0) result = -1;
+    if(result < 0){
+        fprintf(stderr,"%s failed\n",compress ? "compression" : "decompression");
+        return 1;
+    }
+    return 0;
+}
+
+int run_benchmark_command_line(int argc, char *argv[]){
+    size_t generated_size = BENCHMARK_DEFAULT_SIZE, block_size = HS_DEFAULT_BLOCK_SIZE;
+    int repetitions = 3, max_code_length = DEFAULT_MAX_CODE_LENGTH, i = 2;
+    while(i+1 < argc && argv[i][0] == '-' && argv[i][1] != '\0'){
+        if(strcmp(argv[i],"-r") == 0) repetitions = atoi(argv[i+1]);
+        else if(strcmp(argv[i],"-n") == 0) generated_size = strtoul(argv[i+1],NULL,10);
+        else if(strcmp(argv[i],"-b") == 0) block_size = strtoul(argv[i+1],NULL,10);
+        else if(strcmp(argv[i],"-l") == 0) max_code_length = atoi(argv[i+1]);
+        else break;
+        i += 2;
+    }
+    if(i == argc || repetitions < 1 || block_size == 0 || block_size > HS_MAX_BLOCK_SIZE 
+       || max_code_length < MIN_CODE_LENGTH_LIMIT || max_code_length > BLOCK_MAX_CODE_LENGTH){
+        fprintf(stderr,"usage: %s -bench [-r repetitions] [-n generated size] [-b block size] [-l max code length] corpus...\n",argv[0]);
+        return 1;
+    }
+    return run_benchmark(argv+i,argc-i,generated_size,block_size,max_code_length,repetitions) == 0 ? 0 : 1;
+}
+
+int run_command_line(int argc, char *argv[]){
+    size_t block_size = HS_DEFAULT_BLOCK_SIZE;
+    int mapped = strcmp(argv[1],"-mc") == 0 || strcmp(argv[1],"-md") == 0;
+    int compress = strcmp(argv[1],"-c") == 0 || strcmp(argv[1],"-mc") == 0, num_threads = 1, max_code_length = DEFAULT_MAX_CODE_LENGTH, model_order = 0;
+    int result, i;
+    int valid = argc >= 4 && argc % 2 == 0;
+    for(i=4;valid && i<argc;i+=2){
+        if(compress && strcmp(argv[i],"-b") == 0) block_size = strtoul(argv[i+1],NULL,10);
+        else if(compress && strcmp(argv[i],"-l") == 0) max_code_length = atoi(argv[i+1]);
+        else if(compress && strcmp(argv[i],"-m") == 0) model_order = atoi(argv[i+1]);
+        else if(!mapped && strcmp(argv[i],"-t") == 0) num_threads = atoi(argv[i+1]);
+        else valid = 0;
+    }
+    if(!valid || num_threads < 1){
+        fprintf(stderr,"usage: %s -c input output [-b block size] [-l max code length] [-m model order] [-t threads] | -d input output [-t threads]\n",argv[0]);
+        fprintf(stderr,"       %s -mc input output [-b block size] [-l max code length] [-m model order] | -md input output\n",argv[0]);
+        return 1;
+    }
+    if(mapped && !compress){
+        result = decompress_mapped_file(argv[2],strcmp(argv[3],"-") == 0 ? NULL : argv[3]);
+        if(result < 0) fprintf(stderr,"decompression failed\n");
+        return result < 0 ? 1 : 0;
+    }
+    if(mapped){
+        FILE *output = open_file(argv[3],"wb");
+        if(!output){
+            fprintf(stderr,"cannot open %s\n",argv[3]);
+            return 1;
+        }
+        result = compress_mapped_file(argv[2],output,block_size,max_code_length,model_order);
+        if(output != stdout && fclose(output) != 0) result = -1;
+        if(result < 0) fprintf(stderr,"compression failed\n");
+        return result < 0 ? 1 : 0;
+    }
+    FILE *input = open_file(argv[2],"rb");
+    if(!input){
+        fprintf(stderr,"cannot open %s\n",argv[2]);
+        return 1;
+    }
+    FILE *output = open_file(argv[3],"wb");
+    if(!output){
+        fprintf(stderr,"cannot open %s\n",argv[3]);
+        return 1;
+    }
+    if(compress && num_threads > 1){
+        result = compress_file_parallel(input,output,block_size,max_code_length,model_order,num_threads);
+    }
+    else if(compress) result = compress_file(input,output,block_size,max_code_length,model_order);
+    else{
+        result = num_threads > 1 ? decompress_file_parallel(input,output,num_threads) : 1;
+        if(result == 1) result = decompress_file(input,output);
+    }
+    if(input != stdin) fclose(input);
+    if(output != stdout && fclose(output) != 0) result = -1;
+    if(result < 0){
+        fprintf(stderr,"%s failed\n",compress ? "compression" : "decompression");
+        return 1;
+    }
+    return 0;
+}
+
+/* END OF COMMAND LINE */
+
+
+int main(int argc, char *argv[]){
+
+    if(argc > 1 && (strcmp(argv[1],"-c") == 0 || strcmp(argv[1],"-d") == 0)) return run_command_line(argc,argv);
+    if(argc > 1 && (strcmp(argv[1],"-mc") == 0 || strcmp(argv[1],"-md") == 0)) return run_command_line(argc,argv);
+    if(argc > 1 && (strcmp(argv[1],"-ac") == 0 || strcmp(argv[1],"-ad") == 0 || strcmp(argv[1],"-ab") == 0)){
+        return run_adaptive_command_line(argc,argv);
+    }
+    if(argc > 1 && strcmp(argv[1],"-bench") == 0) return run_benchmark_command_line(argc,argv);
+
+    /* The main test is below. The user insert a string in the command line. The program constructs all
+    data structures and returns the Huffman code of the string. After, the code is decoded back and the
+    string is printed again (if everything goes right). By default, the string is encoded in a self-describing block
+    (packed mode with canonical codes), and we print the bytes of the block in hexadecimal. Run the program with the 
+    argument -debug to see the '0'/'1' code instead. */
+
+    char input_string[max_input_size];
+    scanf("%s",input_string);
+    Arena *arena = Arena_create(ARENA_DEFAULT_CAPACITY);
+    Tree *tree;
+    char *get_string_back;
+    if(argc > 1 && strcmp(argv[1],"-debug") == 0){
+        char *output_code;
+        output_code = encode(arena,input_string,&tree);
+        printf("%s",output_code);
+        printf("\n");
+        get_string_back = decode(output_code,tree);
+        printf("%s\n",get_string_back);
+        printf("%f\n",compression_factor(input_string,output_code));
+        free(output_code);
+    }
+    else{
+        size_t block_size, i;
+        unsigned char *block;
+        block = encode_canonical(input_string,&block_size);
+        for(i=0;i<block_size;i++) printf("%02x",block[i]);
+        printf(" (%zu bytes)\n",block_size);
+        get_string_back = decode_canonical(block,block_size);
+        printf("%s\n",get_string_back);
+        printf("%f\n",packed_compression_factor(input_string,8*block_size));
+        free(block);
+    }
+    free(get_string_back);
 
 
     /* SOME TESTS */
 
     /* PQ *q = PQ_initialize();
     q = (PQ*)malloc(sizeof(PQ));
+    q->tree = Tree_create(arena);
 
-    Node *node1 = create_leaf_node('a',6,NULL);
-    Node *node2 = create_leaf_node('b',10,NULL);
-    Node *node3 = create_leaf_node('c', 3,NULL);
-    Node *node4 = create_leaf_node('d',11,NULL);
-    q->queue[0] = node1;
-    q->queue[1] = node2;
-    q->queue[2] = node3;
-    q->queue[3] = node4;
+    q->queue[0] = create_leaf_node(q->tree,'a',6,NO_NODE);
+    q->queue[1] = create_leaf_node(q->tree,'b',10,NO_NODE);
+    q->queue[2] = create_leaf_node(q->tree,'c', 3,NO_NODE);
+    q->queue[3] = create_leaf_node(q->tree,'d',11,NO_NODE);
     q->size = 4;
     LL *list_of_addresses = LL_initialize();
-    Node *tree = tree_builder(q,&list_of_addresses);
+    Tree *tree = tree_builder(arena,q,&list_of_addresses);
     
     Map *map;
-    map = (Map*)malloc(sizeof(Map));
-    map = build_map_of_codes(list_of_addresses,tree);
+    map = build_map_of_codes(arena,list_of_addresses,tree);
     printf("%s",search_code('a',map));
     printf("\n");
-    print_coding_tree(tree);
+    print_coding_tree(tree,tree->root);
     printf("\n"); */
     
 
@@ -515,23 +3434,24 @@ int main(){
     /*Building all data structures from input string: 
 
     PQ *pq_test = PQ_initialize();
-    pq_test = create_PQ_from_string(input_string);
+    pq_test = create_PQ_from_string(arena,input_string);
     print_priority_queue(pq_test);
     LL *list_of_addresses = LL_initialize();
-    Node *tree2 = tree_builder(pq_test,&list_of_addresses);
-    print_coding_tree(tree2);
+    Tree *tree2 = tree_builder(arena,pq_test,&list_of_addresses);
+    print_coding_tree(tree2,tree2->root);
     LL *iter = list_of_addresses;
     while(iter){
-        printf("%c--",iter->tree_node->character);
+        printf("%c--",tree2->nodes[iter->tree_node].character);
         iter = iter->next;
     }
     printf("\n");
     Map *map;
-    map = build_map_of_codes(list_of_addresses,tree2);
+    map = build_map_of_codes(arena,list_of_addresses,tree2);
     printf("\n");
     print_map(map);
     printf("\n");
    */
 
+    Arena_free(arena);
     return 0;
 }
\ No newline at end of file